@@ -0,0 +1,346 @@
+#include "abc.hpp"
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+Abc::Abc(const Params &base) : base(base) {}
+
+
+bool AbcFile(const std::string &filename){
+  std::ifstream fin(filename);
+  std::string kind;
+  fin>>kind;
+  return kind=="ABC";
+}
+
+
+void Abc::load(const std::string &filename){
+  std::ifstream fin(filename);
+  if(!fin.good()){
+    std::cerr<<"Could not open ABC file '"<<filename<<"'!"<<std::endl;
+    throw std::runtime_error("Could not open ABC file!");
+  }
+
+  bool tolerance_given = false;
+  std::string line;
+  while(std::getline(fin,line)){
+    std::istringstream ss(line);
+    std::string key;
+    if(!(ss>>key))
+      continue;
+
+    if(key=="ABC"){
+      std::string method;
+      ss>>method;
+      if(method=="Rejection")
+        smc = false;
+      else if(method=="SMC")
+        smc = true;
+      else {
+        std::cerr<<"Unrecognised ABC method! Expected: Rejection, SMC"<<std::endl;
+        throw std::runtime_error("Unrecognised ABC method! Expected: Rejection, SMC");
+      }
+    } else if(key=="Particles"){
+      ss>>particles;
+    } else if(key=="Replicates"){
+      ss>>replicates;
+    } else if(key=="Tolerance"){
+      ss>>tolerance;
+      tolerance_given = true;
+    } else if(key=="Generations"){
+      ss>>generations;
+    } else if(key=="Quantile"){
+      ss>>quantile;
+    } else if(key=="BatchSize"){
+      ss>>batch_size;
+    } else if(key=="MaxDraws"){
+      ss>>max_draws;
+    } else if(key=="Seed"){
+      ss>>seed;
+    } else if(key=="Output"){
+      ss>>output;
+    } else if(key=="Prior"){
+      Prior p;
+      std::string kind;
+      ss>>p.name>>kind>>p.min>>p.max;
+      if(kind=="Uniform")
+        p.log_uniform = false;
+      else if(kind=="LogUniform")
+        p.log_uniform = true;
+      else {
+        std::cerr<<"Unrecognised prior for '"<<p.name<<"'! Expected: Uniform, LogUniform"<<std::endl;
+        throw std::runtime_error("Unrecognised prior! Expected: Uniform, LogUniform");
+      }
+      if(!ss || !(p.min<p.max) || (p.log_uniform && p.min<=0)){
+        std::cerr<<"Bad range for the prior of '"<<p.name<<"'!"<<std::endl;
+        throw std::runtime_error("Bad prior range!");
+      }
+      priors.push_back(p);
+    } else if(key=="Summary"){
+      Target t;
+      ss>>t.name>>t.value>>t.scale;
+      if(!(t.name=="Nspecies" || t.name=="ECDF" || t.name=="AvgOtempdegC" || t.name=="Nalive" || t.name=="AvgElevation")){
+        std::cerr<<"Unrecognised summary '"<<t.name<<"'! Expected: Nspecies, ECDF, AvgOtempdegC, Nalive, AvgElevation"<<std::endl;
+        throw std::runtime_error("Unrecognised summary!");
+      }
+      if(!ss || !(t.scale>0)){
+        std::cerr<<"Summary '"<<t.name<<"' needs a target and a positive scale!"<<std::endl;
+        throw std::runtime_error("Bad summary!");
+      }
+      targets.push_back(t);
+    } else {
+      std::cerr<<"Unrecognised ABC keyword '"<<key<<"'!"<<std::endl;
+      throw std::runtime_error("Unrecognised ABC keyword!");
+    }
+  }
+
+  if(smc && !tolerance_given)
+    tolerance = 0;
+  if(targets.empty())
+    targets.push_back(Target{"ECDF", 0, 1});
+
+  if(priors.empty()){
+    std::cerr<<"ABC file '"<<filename<<"' has no priors!"<<std::endl;
+    throw std::runtime_error("ABC file has no priors!");
+  }
+  if(output.empty()){
+    std::cerr<<"ABC file '"<<filename<<"' has no Output!"<<std::endl;
+    throw std::runtime_error("ABC file has no Output!");
+  }
+  if(particles<1 || replicates<1 || generations<1 || batch_size<1 || !(0<quantile && quantile<=1)){
+    std::cerr<<"Particles, Replicates, Generations and BatchSize must be at least 1 and Quantile in (0,1]!"<<std::endl;
+    throw std::runtime_error("Bad ABC settings!");
+  }
+
+  //Check that the priors name parameters which can be varied
+  std::vector<double> theta = samplePrior();
+  paramsFor(theta);
+}
+
+
+double Abc::uniform(){
+  return (gen()>>11)/9007199254740992.0;
+}
+
+
+std::vector<double> Abc::samplePrior(){
+  std::vector<double> theta(priors.size());
+  for(unsigned int k=0;k<priors.size();k++){
+    const Prior &p = priors[k];
+    if(p.log_uniform)
+      theta[k] = std::exp(std::log(p.min)+uniform()*(std::log(p.max)-std::log(p.min)));
+    else
+      theta[k] = p.min+uniform()*(p.max-p.min);
+  }
+  return theta;
+}
+
+
+double Abc::priorDensity(const std::vector<double> &theta) const {
+  double density = 1;
+  for(unsigned int k=0;k<priors.size();k++){
+    const Prior &p = priors[k];
+    if(!(p.min<=theta[k] && theta[k]<=p.max))
+      return 0;
+    if(p.log_uniform)
+      density /= theta[k]*(std::log(p.max)-std::log(p.min));
+    else
+      density /= p.max-p.min;
+  }
+  return density;
+}
+
+
+//Whether a finished simulation's summaries can be compared with the targets.
+//Besides those which were rejected, simulations which ended without living
+//salamanders on the mountain cannot be, since their average temperature and
+//elevation are 0/0.
+static bool Usable(const Simulation &sim){
+  return !sim.rejected() && sim.status=="Completed" && sim.salive>0;
+}
+
+
+double Abc::distance(const Simulation &sim) const {
+  double d = 0;
+  for(const auto &t: targets){
+    double value = 0;
+    if     (t.name=="Nspecies"    ) value = sim.nspecies;
+    else if(t.name=="ECDF"        ) value = sim.ecdf;
+    else if(t.name=="AvgOtempdegC") value = sim.avg_otempdegC;
+    else if(t.name=="Nalive"      ) value = sim.salive;
+    else if(t.name=="AvgElevation") value = sim.avg_elevation;
+    d += std::abs(value-t.value)/t.scale;
+  }
+  return d;
+}
+
+
+Params Abc::paramsFor(std::vector<double> &theta) const {
+  Params p = base;
+  for(unsigned int k=0;k<priors.size();k++)
+    theta[k] = p.set(priors[k].name, theta[k]);
+  return p;
+}
+
+
+//Simulation j is replicate j%replicates of candidate j/replicates. Unusable
+//simulations are recorded explicitly, and their distances never computed,
+//since the program is built with -ffast-math, under which infinities and NaNs
+//cannot be relied upon to compare as they should.
+std::vector<double> Abc::simulate(const std::vector<Params> &candidates, EnsembleScheduler &scheduler, std::vector<char> &unusable){
+  const int ntasks = candidates.size()*replicates;
+  std::vector<double> d(ntasks);
+  std::vector<char>   sim_unusable(ntasks);
+  scheduler.run(ntasks, [&](int j){
+    Simulation sim(next_run+j, candidates[j/replicates], j/replicates);
+    sim.fork_from = fork_from;
+    sim.runSimulation(&scheduler);
+    sim_unusable[j] = !Usable(sim);
+    d[j]            = sim_unusable[j] ? 0 : distance(sim);
+  });
+  next_run += ntasks;
+
+  std::vector<double> mean(candidates.size(), 0);
+  unusable.assign(candidates.size(), false);
+  for(int j=0;j<ntasks;j++){
+    mean[j/replicates]     += d[j]/replicates;
+    unusable[j/replicates] |= sim_unusable[j];
+  }
+  return mean;
+}
+
+
+template<class F>
+Abc::Population Abc::sampleGeneration(F propose, double eps, EnsembleScheduler &scheduler){
+  Population pop;
+  long draws = 0;
+  while((int)pop.theta.size()<particles && draws<max_draws){
+    std::vector< std::vector<double> > batch;
+    std::vector<Params>                batch_params;
+    for(int b=0;b<batch_size && draws<max_draws;b++,draws++){
+      batch.push_back(propose());
+      batch_params.push_back(paramsFor(batch.back()));
+    }
+
+    std::vector<char> unusable;
+    const std::vector<double> d = simulate(batch_params, scheduler, unusable);
+
+    //Candidates are accepted in the order they were drawn. A candidate any of
+    //whose replicates was unusable is never accepted, whatever the tolerance.
+    for(unsigned int b=0;b<batch.size() && (int)pop.theta.size()<particles;b++)
+      if(!unusable[b] && d[b]<=eps){
+        pop.theta.push_back(batch[b]);
+        pop.distance.push_back(d[b]);
+        pop.weight.push_back(1);
+      }
+  }
+
+  if((int)pop.theta.size()<particles)
+    std::cerr<<"ABC accepted only "<<pop.theta.size()<<" of "<<particles
+             <<" particles in "<<max_draws<<" draws!"<<std::endl;
+
+  for(auto &w: pop.weight)
+    w /= pop.weight.size();
+  return pop;
+}
+
+
+void Abc::run(EnsembleScheduler &scheduler){
+  gen.seed(seed);
+
+  std::ofstream fout(output);
+  if(!fout.good()){
+    std::cerr<<"Could not open ABC output file '"<<output<<"'!"<<std::endl;
+    throw std::runtime_error("Could not open ABC output file!");
+  }
+  fout<<"Generation, Particle, Weight, Distance";
+  for(const auto &p: priors)
+    fout<<", "<<p.name;
+  fout<<std::endl;
+
+  const unsigned int nparams = priors.size();
+  const double       pi      = 3.14159265358979323846;
+
+  Population pop;
+  double eps = smc ? std::numeric_limits<double>::infinity() : tolerance;
+  for(int g=0;g<(smc?generations:1);g++){
+    if(g==0){
+      pop = sampleGeneration([&](){ return samplePrior(); }, eps, scheduler);
+    } else {
+      //The tolerance shrinks to a quantile of the last generation's distances.
+      //These are all finite, since unusable candidates are never accepted.
+      std::vector<double> sorted = pop.distance;
+      std::sort(sorted.begin(), sorted.end());
+      eps = std::max(tolerance, sorted[(std::size_t)(quantile*(sorted.size()-1))]);
+
+      //Candidates are drawn from the last generation by weight and perturbed
+      //by a Gaussian kernel whose variance is twice the particles' weighted
+      //variance
+      std::vector<double> sigma(nparams);
+      for(unsigned int k=0;k<nparams;k++){
+        double mean = 0, var = 0;
+        for(unsigned int i=0;i<pop.theta.size();i++)
+          mean += pop.weight[i]*pop.theta[i][k];
+        for(unsigned int i=0;i<pop.theta.size();i++)
+          var  += pop.weight[i]*std::pow(pop.theta[i][k]-mean,2);
+        sigma[k] = std::sqrt(2*var);
+      }
+      std::vector<double> cumulative(pop.weight.size());
+      std::partial_sum(pop.weight.begin(), pop.weight.end(), cumulative.begin());
+
+      auto normal = [&](){
+        return std::sqrt(-2*std::log(1-uniform()))*std::cos(2*pi*uniform());
+      };
+
+      const Population prev = pop;
+      pop = sampleGeneration([&](){
+        std::vector<double> theta(nparams);
+        do {
+          const double u = uniform()*cumulative.back();
+          const std::size_t j = std::min(
+            (std::size_t)(std::upper_bound(cumulative.begin(), cumulative.end(), u)-cumulative.begin()),
+            cumulative.size()-1
+          );
+          for(unsigned int k=0;k<nparams;k++)
+            theta[k] = prev.theta[j][k]+sigma[k]*normal();
+        } while(priorDensity(theta)==0);
+        return theta;
+      }, eps, scheduler);
+
+      //Importance weights: the prior density over the density of drawing the
+      //particle from the last generation
+      for(unsigned int i=0;i<pop.theta.size();i++){
+        double proposal = 0;
+        for(unsigned int j=0;j<prev.theta.size();j++){
+          double kernel = prev.weight[j];
+          for(unsigned int k=0;k<nparams;k++)
+            if(sigma[k]>0)
+              kernel *= std::exp(-std::pow((pop.theta[i][k]-prev.theta[j][k])/sigma[k],2)/2)/sigma[k];
+          proposal += kernel;
+        }
+        pop.weight[i] = priorDensity(pop.theta[i])/proposal;
+      }
+      const double total = std::accumulate(pop.weight.begin(), pop.weight.end(), 0.0);
+      for(auto &w: pop.weight)
+        w /= total;
+    }
+
+    std::cerr<<"ABC generation "<<g<<": tolerance "<<eps<<", accepted "
+             <<pop.theta.size()<<" particles"<<std::endl;
+
+    for(unsigned int i=0;i<pop.theta.size();i++){
+      fout<<g<<", "<<i<<", "<<pop.weight[i]<<", "<<pop.distance[i];
+      for(const auto v: pop.theta[i])
+        fout<<", "<<v;
+      fout<<"\n";
+    }
+    fout.flush();
+
+    if(pop.theta.empty())
+      break;
+  }
+}
@@ -0,0 +1,140 @@
+#ifndef _abc_hpp_
+#define _abc_hpp_
+
+#include "params.hpp"
+#include "simulation.hpp"
+#include "scheduler.hpp"
+#include <random>
+#include <string>
+#include <vector>
+#include <limits>
+
+//Abc fits the model's parameters by approximate Bayesian computation. Candidate
+//parameter sets are drawn from priors and simulated, and those whose summaries
+//come within a tolerance of the targets are kept as samples of the posterior.
+//Rejection ABC draws every candidate from the priors. SMC ABC (Beaumont et al.
+//2009, Biometrika 96:983) runs several generations of shrinking tolerance,
+//drawing each generation's candidates by perturbing the previous generation's
+//particles, and weights the particles accordingly.
+//
+//The candidates are simulated in batches on the ensemble scheduler and taken in
+//the order they were drawn, so, for a given configuration, the results do not
+//depend on the number of threads.
+//
+//An ABC file is given in place of a sweep file. It begins with "ABC", followed
+//by the method and then keyword lines in any order:
+//
+//  ABC          Rejection or SMC
+//  Particles    <n>          Number of particles to accept (per generation)
+//  Replicates   <n>          Simulations of each candidate; distances are averaged
+//  Tolerance    <eps>        Greatest distance accepted. For SMC, the smallest
+//                            tolerance used; defaults to 0 for SMC and infinity
+//                            for Rejection.
+//  Generations  <n>          SMC: number of generations
+//  Quantile     <q>          SMC: each generation's tolerance is this quantile of
+//                            the previous generation's distances
+//  BatchSize    <n>          Candidates simulated at a time
+//  MaxDraws     <n>          Candidates drawn per generation before giving up
+//  Seed         <s>          Seed of the candidate draws
+//  Output       <filename>   Where to write the weighted posterior samples
+//  Prior        <Param> Uniform|LogUniform <min> <max>
+//  Summary      <Name> <target> <scale>
+//
+//Each Summary adds |value-target|/scale to a candidate's distance. The names
+//are those of the summary file's columns: Nspecies, ECDF, AvgOtempdegC, Nalive
+//and AvgElevation. ECDF is itself a distance from the observed phylogeny, so
+//its target is usually 0. Without any Summary lines, the distance is the ECDF.
+//Simulations which are pruned or fail (see Simulation::rejected()), or which
+//end without living salamanders on the mountain, are never accepted, so the
+//pruning parameters can be used to reject hopeless candidates early.
+class Abc {
+ private:
+  struct Prior {
+    std::string name;
+    bool        log_uniform;
+    double      min;
+    double      max;
+  };
+
+  struct Target {
+    std::string name;
+    double      value;
+    double      scale;
+  };
+
+  //A generation of particles
+  struct Population {
+    std::vector< std::vector<double> > theta;
+    std::vector<double>                weight;
+    std::vector<double>                distance;
+  };
+
+  //Parameters which are not being fitted
+  const Params &base;
+
+  bool          smc         = false;
+  int           particles   = 100;
+  int           replicates  = 1;
+  double        tolerance   = std::numeric_limits<double>::infinity();
+  int           generations = 1;
+  double        quantile    = 0.5;
+  int           batch_size  = 64;
+  long          max_draws   = 1000000;
+  unsigned long seed        = 1;
+  std::string   output;
+
+  std::vector<Prior>  priors;
+  std::vector<Target> targets;
+
+  //Generator from which the candidates are drawn
+  std::mt19937_64 gen;
+
+  //Run number of the next simulation. Each simulation is given its own run
+  //number, and so its own random number stream.
+  int next_run = 0;
+
+  //Uniform random number in [0,1)
+  double uniform();
+
+  //Draws a candidate from the priors
+  std::vector<double> samplePrior();
+
+  //Density of the priors at theta
+  double priorDensity(const std::vector<double> &theta) const;
+
+  //Distance of a finished simulation's summaries from the targets
+  double distance(const Simulation &sim) const;
+
+  //Parameters with which to simulate candidate theta. Parameters which take
+  //integer values are rounded, and theta is updated to match.
+  Params paramsFor(std::vector<double> &theta) const;
+
+  //Simulates each candidate, returning its mean distance. unusable[c] is set
+  //if any replicate of candidate c was rejected (see Simulation::rejected())
+  //or ended without living salamanders on the mountain, in which case its
+  //distance is meaningless.
+  std::vector<double> simulate(const std::vector<Params> &candidates, EnsembleScheduler &scheduler, std::vector<char> &unusable);
+
+  //Draws candidates from propose() until particles of them are accepted at
+  //tolerance eps or max_draws have been drawn
+  template<class F>
+  Population sampleGeneration(F propose, double eps, EnsembleScheduler &scheduler);
+
+ public:
+  Abc(const Params &base);
+
+  //Reads the ABC file filename
+  void load(const std::string &filename);
+
+  //If set, every candidate continues on from this snapshot of a shared
+  //history. See Simulation::fork_from.
+  const std::string *fork_from = nullptr;
+
+  //Runs the ABC and writes the posterior samples
+  void run(EnsembleScheduler &scheduler);
+};
+
+//Returns true if filename is an ABC file rather than a sweep file
+bool AbcFile(const std::string &filename);
+
+#endif
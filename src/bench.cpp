@@ -0,0 +1,108 @@
+//Compares the speed of the random number engines available to the simulation.
+//Build with `make bench` and run ./bench.exe. The engine the simulation uses is
+//chosen at compile time; see random.hpp.
+#include "prng_engines.hpp"
+#include "timer.hpp"
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+using namespace std;
+
+//Number of values generated by each benchmark
+const unsigned int N = 50000000;
+
+//Size of the buffers used by the bulk benchmarks
+const unsigned int BUFSIZE = 4096;
+
+//Accumulates results so that the compiler cannot discard the work
+double sink = 0;
+
+template<class Engine>
+void BenchEngine(const string &name){
+  Engine e;
+  std::seed_seq q{1,2,3,4};
+  e.seed(q);
+
+  std::vector<double> buf(BUFSIZE);
+  Timer timer;
+  double acc = 0;
+
+  //Scalar uniform doubles
+  timer.start();
+  for(unsigned int i=0;i<N;i++)
+    acc += UniformReal(e,0,1);
+  timer.stop();
+  const double t_uniform = timer.accumulated();
+
+  //Scalar uniform integers, as used to choose salamanders for breeding
+  timer.reset();
+  timer.start();
+  for(unsigned int i=0;i<N;i++)
+    acc += UniformInt(e,0,999);
+  timer.stop();
+  const double t_int = timer.accumulated();
+
+  //Scalar normals from the standard library
+  std::normal_distribution<double> nd(0,1);
+  timer.reset();
+  timer.start();
+  for(unsigned int i=0;i<N;i++)
+    acc += nd(e);
+  timer.stop();
+  const double t_normal = timer.accumulated();
+
+  //Bulk uniform doubles
+  timer.reset();
+  timer.start();
+  for(unsigned int i=0;i<N;i+=BUFSIZE){
+    FillUniform(e,buf.data(),BUFSIZE,0,1);
+    acc += buf[i%BUFSIZE];
+  }
+  timer.stop();
+  const double t_bulk_uniform = timer.accumulated();
+
+  //Bulk normals
+  timer.reset();
+  timer.start();
+  for(unsigned int i=0;i<N;i+=BUFSIZE){
+    FillNormal(e,buf.data(),BUFSIZE,0,1);
+    acc += buf[i%BUFSIZE];
+  }
+  timer.stop();
+  const double t_bulk_normal = timer.accumulated();
+
+  sink += acc;
+
+  //Report nanoseconds per value
+  const double ns = 1e9/N;
+  cout<<setw(14)<<name
+      <<setw(12)<<t_uniform*ns
+      <<setw(12)<<t_int*ns
+      <<setw(12)<<t_normal*ns
+      <<setw(14)<<t_bulk_uniform*ns
+      <<setw(14)<<t_bulk_normal*ns
+      <<"\n";
+}
+
+int main(){
+  cout<<"Nanoseconds per value ("<<N<<" values per benchmark)\n";
+  cout<<setw(14)<<"Engine"
+      <<setw(12)<<"Uniform"
+      <<setw(12)<<"Int"
+      <<setw(12)<<"Normal"
+      <<setw(14)<<"BulkUniform"
+      <<setw(14)<<"BulkNormal"
+      <<"\n";
+  cout<<fixed<<setprecision(3);
+
+  BenchEngine<std::mt19937>("mt19937");
+  BenchEngine<Xoshiro256pp>("xoshiro256++");
+  BenchEngine<Pcg64>       ("pcg64");
+  BenchEngine<Philox4x64>  ("philox4x64");
+
+  cerr<<"Checksum: "<<sink<<endl;
+  return 0;
+}
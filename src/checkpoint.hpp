@@ -0,0 +1,76 @@
+//Checkpoints save the full state of a running simulation to a binary file so
+//that it can be resumed later, on another node if need be, exactly as though it
+//had never stopped. These functions read and write the values the checkpoints
+//are made of. Values are written in the machine's native byte order and
+//layout, so a checkpoint can only be read by a build for the same kind of
+//machine.
+#ifndef _checkpoint_hpp_
+#define _checkpoint_hpp_
+
+#include <istream>
+#include <ostream>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+
+///Identifies a file as a checkpoint
+const char CHECKPOINT_MAGIC[8] = {'S','A','L','C','K','P','T','\0'};
+
+///Incremented whenever the layout of a checkpoint changes. Checkpoints of other
+///versions are refused.
+const std::uint32_t CHECKPOINT_VERSION = 3;
+
+template<class T>
+void WriteBinary(std::ostream &out, const T &x){
+  static_assert(std::is_trivially_copyable<T>::value, "Only plain values can be written directly");
+  out.write(reinterpret_cast<const char*>(&x), sizeof(T));
+}
+
+template<class T>
+void ReadBinary(std::istream &in, T &x){
+  static_assert(std::is_trivially_copyable<T>::value, "Only plain values can be read directly");
+  in.read(reinterpret_cast<char*>(&x), sizeof(T));
+  if(!in)
+    throw std::runtime_error("Checkpoint is truncated!");
+}
+
+///Vectors are written as their length followed by their elements
+template<class T>
+void WriteBinary(std::ostream &out, const std::vector<T> &v){
+  static_assert(std::is_trivially_copyable<T>::value, "Only vectors of plain values can be written directly");
+  WriteBinary(out, (std::uint64_t)v.size());
+  if(!v.empty())
+    out.write(reinterpret_cast<const char*>(v.data()), v.size()*sizeof(T));
+}
+
+template<class T>
+void ReadBinary(std::istream &in, std::vector<T> &v){
+  static_assert(std::is_trivially_copyable<T>::value, "Only vectors of plain values can be read directly");
+  std::uint64_t n;
+  ReadBinary(in, n);
+  v.resize(n);
+  if(n>0)
+    in.read(reinterpret_cast<char*>(v.data()), n*sizeof(T));
+  if(!in)
+    throw std::runtime_error("Checkpoint is truncated!");
+}
+
+///Strings are written as their length followed by their characters
+inline void WriteBinary(std::ostream &out, const std::string &s){
+  WriteBinary(out, (std::uint64_t)s.size());
+  out.write(s.data(), s.size());
+}
+
+inline void ReadBinary(std::istream &in, std::string &s){
+  std::uint64_t n;
+  ReadBinary(in, n);
+  s.resize(n);
+  if(n>0)
+    in.read(&s[0], n);
+  if(!in)
+    throw std::runtime_error("Checkpoint is truncated!");
+}
+
+#endif
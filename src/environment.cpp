@@ -0,0 +1,73 @@
+#include "environment.hpp"
+#include "mtbin.hpp"
+#include "timeline.hpp"
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <tuple>
+
+//The environment is computed by the bins' own methods so that the table holds
+//exactly the values they would have computed
+Environment::Environment(const std::vector<double> &heights, const Params &params, double origin){
+  this->heights     = heights;
+  this->origin      = origin;
+  this->timestep    = params.timestep();
+  this->vary_height = params.pVaryHeight();
+
+  std::vector<MtBin> bins;
+  for(const auto h: heights)
+    bins.push_back(MtBin(h, params));
+
+  for(double tMyrs=origin;BeforeEndOfTime(tMyrs);tMyrs+=params.timestep()){
+    t.push_back(tMyrs);
+    max_height.push_back(MtBin::heightMaxKm(tMyrs, params));
+    for(const auto &b: bins){
+      temp.push_back(b.temp(tMyrs));
+      area.push_back(b.area(b.heightkm(), tMyrs));
+      above_summit.push_back(b.heightkm()>=max_height.back());
+    }
+  }
+}
+
+
+
+Environment::Step Environment::at(double tMyrs) const {
+  const long k = std::lround((tMyrs-origin)/timestep);
+  if(k<0 || k>=(long)t.size() || t[k]!=tMyrs){
+    std::cerr<<"The environment table has no timestep at "<<tMyrs<<" Myr!"<<std::endl;
+    throw std::runtime_error("The environment table has no such timestep!");
+  }
+  const std::size_t row = k*heights.size();
+  Step step;
+  step.max_height   = max_height[k];
+  step.temp         = &temp[row];
+  step.area         = &area[row];
+  step.above_summit = &above_summit[row];
+  return step;
+}
+
+
+
+//Tables are only kept while a simulation is using them, so that a long fit over
+//many parameters does not accumulate them
+std::shared_ptr<const Environment> Environment::Shared(const std::vector<double> &heights, const Params &params, double origin){
+  typedef std::tuple<std::vector<double>, double, bool, double> Key;
+  static std::map<Key, std::weak_ptr<const Environment> > tables;
+  static std::mutex mtx;
+
+  const Key key(heights, params.timestep(), params.pVaryHeight(), origin);
+  std::lock_guard<std::mutex> lock(mtx);
+  std::shared_ptr<const Environment> table = tables[key].lock();
+  if(!table){
+    for(auto i=tables.begin();i!=tables.end();)
+      if(i->second.expired())
+        i = tables.erase(i);
+      else
+        ++i;
+    table = std::make_shared<const Environment>(heights, params, origin);
+    tables[key] = table;
+  }
+  return table;
+}
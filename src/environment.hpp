@@ -0,0 +1,60 @@
+//The environment of the mountain bins, their temperature, area, and whether
+//they lie above the summit, depends only on time and the bins' heights. Rather
+//than recomputing it for every salamander in every bin, a simulation looks it
+//up in a table holding the environment of every bin at every timestep, built
+//once and shared, read-only, by every simulation with the same timeline.
+#ifndef _environment_hpp_
+#define _environment_hpp_
+
+#include "params.hpp"
+#include <vector>
+#include <memory>
+
+class Environment {
+ public:
+  ///Environment of the bins at one timestep. Each array is indexed by bin.
+  struct Step {
+    ///Height of the summit IN KILOMETERS. See MtBin::heightMaxKm()
+    double               max_height;
+    ///Temperature of each bin. See MtBin::temp()
+    const double        *temp;
+    ///Area of each bin, from which its carrying capacity follows. See
+    ///MtBin::area()
+    const double        *area;
+    ///Non-zero if the bin is at or above the summit, in which case it is
+    ///uninhabitable
+    const unsigned char *above_summit;
+  };
+
+  ///Builds the table for bins of the given heights, in kilometers, at the
+  ///timesteps origin, origin+timestep, origin+2*timestep, ... up to the end of
+  ///the simulation. The times are accumulated exactly as in the simulation's
+  ///main loop, so they match its times bit for bit.
+  Environment(const std::vector<double> &heights, const Params &params, double origin);
+
+  ///Returns the environment at time tMyrs, which must be one of the table's
+  ///timesteps
+  Step at(double tMyrs) const;
+
+  ///Returns a table for the given heights, parameters, and origin, sharing
+  ///the table of any simulation with the same ones which is still running.
+  ///Thread-safe.
+  static std::shared_ptr<const Environment> Shared(const std::vector<double> &heights, const Params &params, double origin);
+
+ private:
+  std::vector<double> heights;
+  double              origin;
+  double              timestep;
+  bool                vary_height;
+
+  ///Time of each timestep
+  std::vector<double>        t;
+  ///max_height[k] is the height of the summit at timestep k
+  std::vector<double>        max_height;
+  ///Entry [k*heights.size()+m] describes bin m at timestep k
+  std::vector<double>        temp;
+  std::vector<double>        area;
+  std::vector<unsigned char> above_summit;
+};
+
+#endif
@@ -9,7 +9,12 @@
 #include "random.hpp"
 #include "params.hpp"
 #include "timer.hpp"
+#include "writer.hpp"
+#include "scheduler.hpp"
+#include "sweep.hpp"
+#include "abc.hpp"
 #include <array>
+#include <memory>
 #include <vector>
 #include <iostream>
 #include <fstream>
@@ -19,32 +24,17 @@
 #include "omp.h"
 using namespace std;
 
-string SimulationSummaryHeader() {
-  return "RunNum, MutationProb, TempDriftSD, SimThresh, Nspecies, ECDF, "
-         "AvgOtempdegC, Nalive, EndTime, AvgElevation";
-}
-
-void printSimulationSummary(ofstream &out, int r, const Simulation &sim){
-  out<<r;
-  out<<", " << TheParams.mutationProb();
-  out<<", " << TheParams.tempDrift();
-  out<<", " << TheParams.speciesSimthresh();
-  out<<", " << sim.nspecies;
-  out<<", " << sim.ecdf;
-  out<<", " << sim.avg_otempdegC;
-  out<<", " << sim.salive;
-  out<<", " << sim.endtime;
-  out<<", " << sim.avg_elevation;
-  out<<endl;
-}
-
 int main(int argc, char **argv){
   Timer timer_overall, timer_calc, timer_io;
 
   timer_overall.start();
 
-  if(argc!=2){
-    cout<<"Syntax: "<<argv[0]<<" <Parameters File>\n";
+  if(argc!=2 && argc!=3){
+    cout<<"Syntax: "<<argv[0]<<" <Parameters File> [Sweep File|ABC File]\n";
+    cout<<"If a sweep file is given, the ensemble is run for each of its\n";
+    cout<<"parameter sets. See sweep.hpp for its format. If an ABC file is\n";
+    cout<<"given, the parameters are instead fitted by approximate Bayesian\n";
+    cout<<"computation. See abc.hpp for its format.\n";
     cout<<"Parmeters file can contain:\n";
     cout<<"\tPARAM                     TYPE        DESCRIPTION\n";
     cout<<"\tSummaryStatsFilename      Filename               \n";
@@ -88,15 +78,73 @@ int main(int argc, char **argv){
     cout<<"\tMaxTriesToBreed           Integer     \n";
     cout<<"\tToLowlandsProb            Double      \n";
     cout<<"\tFromLowlandsProb          Double      \n";
+    cout<<"\tMortalityKernel           String      ";
+      cout<<"Must be: Exact, FastSigmoid\n";
+    cout<<"\tDispersalSampling         String      ";
+      cout<<"Must be: PerIndividual, Geometric\n";
+    cout<<"\tBreedingMode              String      ";
+      cout<<"Must be: Rejection, Bucketed\n";
+    cout<<"\tBinThreads                Integer     ";
+      cout<<"Threads used to process the bins of each simulation.\n";
+    cout<<"\tDispersalStage            String      ";
+      cout<<"Must be: Immediate, Outbox\n";
+    cout<<"\tNewickExtantOnly          YES/NO      ";
+      cout<<"Write only living species to the phylogeny file.\n";
+    cout<<"\tStatsRecording            String      ";
+      cout<<"Must be: All, Window, FinalStep\n";
+    cout<<"\tStatsWindowStart          Double      ";
+      cout<<"Start of the stats window in Myrs (Window only).\n";
+    cout<<"\tStatsWindowEnd            Double      ";
+      cout<<"End of the stats window in Myrs (Window only).\n";
+    cout<<"\tStatsStride               Integer     ";
+      cout<<"Record every n-th timestep in the window (Window only).\n";
+    cout<<"\tPruneCheckInterval        Double      ";
+      cout<<"Myrs between the pruning checks below; 0 disables them.\n";
+    cout<<"\tPruneMinAlive             Integer     ";
+      cout<<"Prune if fewer salamanders are alive at a check.\n";
+    cout<<"\tPruneMaxAlive             Integer     ";
+      cout<<"Prune if more salamanders are alive at a check; 0 = no bound.\n";
+    cout<<"\tPruneMinSpecies           Integer     ";
+      cout<<"Prune if fewer species are alive at a check.\n";
+    cout<<"\tPruneMaxSpecies           Integer     ";
+      cout<<"Prune if more species are alive at a check; 0 = no bound.\n";
+    cout<<"\tPruneMaxECDF              Double      ";
+      cout<<"Prune if the ECDF score at a check exceeds this; <0 = no bound.\n";
+    cout<<"\tPruneECDFStart            Double      ";
+      cout<<"Myrs from which PruneMaxECDF applies.\n";
+    cout<<"\tPruneMaxSeconds           Double      ";
+      cout<<"Prune after this much wall-clock time; 0 = no limit.\n";
+    cout<<"\tPruneMaxSteps             Integer     ";
+      cout<<"Prune after this many timesteps; 0 = no limit.\n";
+    cout<<"\tCheckpointInterval        Double      ";
+      cout<<"Myrs between checkpoints; 0 = never. See params.hpp.\n";
+    cout<<"\tCheckpointPrefix          Filename    ";
+      cout<<"Checkpoints are <prefix>_<run>.ckpt\n";
+    cout<<"\tForkTime                  Double      ";
+      cout<<"Myrs of history the runs share; 0 = none. See params.hpp.\n";
+    cout<<"\tForkSnapshot              Filename    ";
+      cout<<"Where the shared history is saved\n";
+    cout<<"\tMortalityAbundance        String      ";
+      cout<<"Must be: Legacy, StartOfStep. See params.hpp.\n";
 
     return -1;
   }
 
   TheParams.load(argv[1]);
 
-  //Seed random number generator for each thread
+  //The parameter sets to run. Without a sweep file, this is just the
+  //parameters file.
+  const bool abc_mode = argc==3 && AbcFile(argv[2]);
+  Sweep sweep(TheParams);
+  if(argc==3 && !abc_mode)
+    sweep.load(argv[2], TheParams);
+
+  //Set the seed from which each run's random number stream is derived. If the
+  //seed was drawn from entropy, report it so that any run can be reproduced.
   timer_calc.start();
-  seed_rand(TheParams.randomSeed());
+  unsigned long seed = seed_rand(TheParams.randomSeed());
+  if(TheParams.randomSeed()==0)
+    cerr<<"PRNG seed:    "<<seed<<endl;
   timer_calc.stop();
 
   //Load temperature data into global object
@@ -118,68 +166,79 @@ int main(int argc, char **argv){
     return -1;
   }
 
-  //Create a vector to hold the runs
-  vector<Simulation> runs;
+  //Used to show more detailed, real-time info about simulation. Only one
+  //simulation is run, on one thread.
+  if(TheParams.debug())
+    omp_set_num_threads(1);
+
+  //Each simulation may use several threads to process its bins. This nests
+  //inside the parallelism across simulations, so nesting must be enabled.
+  if(TheParams.binThreads()>1)
+    omp_set_max_active_levels(2);
 
-  //Load a number of runs into the vector. Each run has the same parameters, but
-  //the runs will differ due to random factors.
-  for(int i=0;i<TheParams.maxiter();i++)
-    runs.emplace_back();
+  EnsembleScheduler scheduler(omp_get_max_threads());
 
-  //Used to show more detailed, real-time info about simulation
-  if(TheParams.debug()){
-    omp_set_num_threads(1);
-    runs.clear();
-    runs.emplace_back();
+  //The runs of a fork ensemble continue on from a shared history, which is
+  //simulated, or read, once
+  std::string fork_snapshot;
+  if(TheParams.forkTime()>0){
+    timer_calc.start();
+    fork_snapshot = Simulation::ForkSnapshot(TheParams);
+    timer_calc.stop();
+  }
+  const std::string *fork_from = TheParams.forkTime()>0 ? &fork_snapshot : nullptr;
+
+  //Fit the parameters instead of running an ensemble. Only the posterior
+  //samples are written.
+  if(abc_mode){
+    Abc abc(TheParams);
+    abc.load(argv[2]);
+    abc.fork_from = fork_from;
+    timer_calc.start();
+    abc.run(scheduler);
+    timer_calc.stop();
+    timer_overall.stop();
+
+    cerr<<"Time overall: "<<timer_overall.accumulated() <<endl;
+    cerr<<"Time calc:    "<<timer_calc.accumulated()    <<endl;
+    return 0;
   }
 
-  //Run the simulations in parallel using OpenMP
+  //Number of runs in the ensemble. Each parameter set is run maxiter times; the
+  //runs of a set differ due to random factors. Run i uses parameter set
+  //i/maxiter and always draws from the same random number stream, so its
+  //results do not depend on the number of threads.
+  int nruns = TheParams.maxiter()*sweep.sets.size();
+
+  if(TheParams.debug())
+    nruns = 1;
+
+  //Run the simulations in parallel. Each finished run is handed to the writer,
+  //which writes the results of the runs in order while the others are still
+  //running, and frees each run once it is written. The scheduler starts runs in
+  //order, so the writer is never kept waiting on a run which has not been
+  //started.
+  ResultWriter writer(omp_get_max_threads(), sweep);
   timer_calc.start();
-  #pragma omp parallel for
-  for(unsigned int i=0;i<runs.size();++i){
-    //#pragma omp critical
-    //  cout<<"Run #"<<i<<endl;
-    runs[i].runSimulation();
-    //runs[i].dumpPhylogeny();
-  }
+  scheduler.run(nruns, [&](int i){
+    const int set = i/TheParams.maxiter();
+    std::unique_ptr<Simulation> sim(new Simulation(i, sweep.sets[set], set));
+    sim->fork_from = fork_from;
+    sim->runSimulation(&scheduler);
+    writer.submit(std::move(sim));
+  });
   timer_calc.stop();
 
-  //cerr<<"Printing output information..."<<endl;
-  
   timer_io.start();
-  //Print out the summary statistics of all of the runs
-  ofstream f_summary(TheParams.outSummaryFilename());
-  f_summary<<SimulationSummaryHeader()<<endl;
-  for(unsigned int r=0;r<runs.size();++r)
-    printSimulationSummary(f_summary, r, runs[r]);
-
-  //Output persistence table for each run within the boundaries
-  {
-    ofstream f_persist(TheParams.outPersistFilename());
-    for(unsigned int i=0;i<runs.size();i++)
-      runs[i].phylos.persistGraph(i, f_persist);
-  }
-
-  //Output phylogeny for each run within the boundaries
-  {
-    ofstream f_phylogeny(TheParams.outPhylogenyFilename());
-    for(unsigned int i=0;i<runs.size();i++)
-      f_phylogeny<<i<<" "<<runs[i].phylos.printNewick()<<endl;
-  }
-
-  //Output summaries of the distribution of species properties at each point
-  //in time
-  {
-    ofstream f_species_stats(TheParams.outSpeciesStatsFilename());
-    for(unsigned int i=0;i<runs.size();i++)
-      runs[i].phylos.speciesSummaries(i, f_species_stats);
-  }
+  writer.finish();
   timer_io.stop();
   timer_overall.stop();
 
   cerr<<"Time overall: "<<timer_overall.accumulated() <<endl;
   cerr<<"Time calc:    "<<timer_calc.accumulated()    <<endl;
   cerr<<"Time IO:      "<<timer_io.accumulated()      <<endl;
+  cerr<<"Time writing: "<<writer.ioTime()             <<endl;
+  scheduler.printUtilization(cerr);
 
   return 0;
 }
\ No newline at end of file
@@ -0,0 +1,30 @@
+#include "mortality.hpp"
+#include "params.hpp"
+#include <cmath>
+
+void DeathProbabilities(
+  const double *otempdegC,
+  const double *abundance_term,
+  unsigned int  n,
+  double        tempdegC,
+  double        offset,
+  double        temp_weight,
+  int           kernel,
+  double       *pdeath
+){
+  //The branch is hoisted out of the loops so that each loop is a straight run
+  //of arithmetic which can be vectorized
+  if(kernel==MORTALITY_FAST_SIGMOID){
+    #pragma omp simd
+    for(unsigned int i=0;i<n;i++){
+      const double dtemp = (otempdegC[i]-tempdegC)*(otempdegC[i]-tempdegC);
+      pdeath[i] = FastSigmoid(offset+dtemp*temp_weight+abundance_term[i]);
+    }
+  } else {
+    #pragma omp simd
+    for(unsigned int i=0;i<n;i++){
+      const double dtemp = (otempdegC[i]-tempdegC)*(otempdegC[i]-tempdegC);
+      pdeath[i] = 1/(1+std::exp(-(offset+dtemp*temp_weight+abundance_term[i])));
+    }
+  }
+}
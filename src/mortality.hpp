@@ -0,0 +1,66 @@
+//This file contains a kernel which evaluates the salamanders' logit probability
+//of death (see Salamander::pDie()) for a whole bin at once. Everything which is
+//constant within a bin is computed once by the caller, leaving a tight loop
+//over contiguous arrays which the compiler vectorizes, using SIMD versions of
+//exp() where available.
+#ifndef _mortality_hpp_
+#define _mortality_hpp_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+///Upper bound on the absolute difference between FastSigmoid() and the exact
+///logistic function 1/(1+exp(-x)). Verified by test.exe.
+const double FAST_SIGMOID_MAX_ERROR = 1e-7;
+
+///Approximates exp(x) by splitting x*log2(e) into an integer and a fractional
+///part. 2^fraction is evaluated with a degree 6 polynomial and the integer part
+///is written directly into the exponent bits of the result. The relative error
+///is below 2e-7, which gives the bound on FastSigmoid() above since the
+///logistic function's slope never exceeds 1/4.
+inline double FastExp(double x){
+  //Keep the exponent within the range of a double
+  x = std::min(std::max(x,-700.0),700.0);
+
+  const double y = x*1.4426950408889634;           //x*log2(e)
+  const double n = std::floor(y+0.5);              //Nearest integer
+  const double r = (y-n)*0.6931471805599453;       //Remainder in [-ln2/2,ln2/2]
+
+  //Taylor series for exp(r)
+  const double p = 1+r*(1+r*(1/2.+r*(1/6.+r*(1/24.+r*(1/120.+r*(1/720.))))));
+
+  //Build 2^n by writing n into the exponent bits of a double
+  const int64_t bits = (int64_t)((int)n+1023)<<52;
+  double scale;
+  std::memcpy(&scale,&bits,sizeof(double));
+
+  return p*scale;
+}
+
+///Approximation of the logistic function 1/(1+exp(-x)). Differs from the exact
+///value by at most FAST_SIGMOID_MAX_ERROR.
+inline double FastSigmoid(double x){
+  return 1/(1+FastExp(-x));
+}
+
+///Calculates the probability of death of n salamanders living in a bin with
+///temperature tempdegC. The logit of each salamander's probability of death is
+///offset + temp_weight*(otempdegC[i]-tempdegC)^2 + abundance_term[i], where
+///abundance_term[i] holds the weighted conspecific and heterospecific
+///abundances experienced by salamander i. `kernel` is one of MORTALITY_EXACT or
+///MORTALITY_FAST_SIGMOID. Results are written to pdeath, which must have space
+///for n values.
+void DeathProbabilities(
+  const double *otempdegC,
+  const double *abundance_term,
+  unsigned int  n,
+  double        tempdegC,
+  double        offset,
+  double        temp_weight,
+  int           kernel,
+  double       *pdeath
+);
+
+#endif
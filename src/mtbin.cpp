@@ -1,12 +1,15 @@
 #include "mtbin.hpp"
 #include "temp.hpp"
 #include "random.hpp"
+#include "mortality.hpp"
+#include "checkpoint.hpp"
 #include <algorithm>
 #include <cassert>
 #include <cmath>
-#include <iterator>
+#include <cstdint>
 #include <iostream>
 #include <iomanip>
+#include <random>
 #include <stdexcept>
 
 ///Generic Gaussian distribution function
@@ -15,10 +18,13 @@ double Gaussian(double x, double mean, double sigma){
   return 1/sigma/std::sqrt(2*PI)*std::exp(-std::pow(x-mean,2)/2/std::pow(sigma,2));
 }
 
-MtBin::MtBin(){}
+MtBin::MtBin(){
+  params = nullptr;
+}
 
-MtBin::MtBin(double heightkm_val){
+MtBin::MtBin(double heightkm_val, const Params &params){
   this->heightkm_val = heightkm_val;
+  this->params       = &params;
   //Reserve enough space to hold the maximum population. This keeps things
   //running fast by reducing the need to dynamically reallocate memory.
   bin.reserve(2000);
@@ -32,8 +38,8 @@ double MtBin::heightkm() const {
 
 
 ///Returns the maximum height of the mountain range at the given time
-double MtBin::heightMaxKm(double tMyrs) {
-  if(!TheParams.pVaryHeight()) tMyrs=65;
+double MtBin::heightMaxKm(double tMyrs, const Params &params) {
+  if(!params.pVaryHeight()) tMyrs=65;
 
   //Maximum elevation of the mountain range over time
   //Based on linear shrinking of mountain height from 2.8km at 65Mya (according
@@ -48,60 +54,110 @@ double MtBin::heightMaxKm(double tMyrs) {
 
 //Removes a salamander from this bin. The removed salamander ceases to exist,
 //which, for our purposes, is the same as killing it.
-void MtBin::killSalamander(MtBin::container::iterator s) {
+void MtBin::killSalamander(unsigned int s) {
   assert(!bin.empty());
 
   //We overwrite the indicated salamander, which is now dead, with the
-  //salamander at the back of the bin, which is still alive. If this method is
-  //called by an iterator the iterator must decrement and then advance so that
-  //the swapped salamander is still considered
-  *s = bin.back();
-
-  //Pop the salamander at the back of the container, because it is now a
-  //duplicate and should never be accessed.
-  bin.pop_back();
+  //salamander at the back of the bin, which is still alive, and then pop the
+  //back of the bin. If this method is called from a loop the loop must
+  //consider index s again so that the swapped salamander is still considered.
+  bin.swapRemove(s);
 }
 
 
-void MtBin::mortaliate(double tMyrs, int max_species, int species_sim_thresh) {
+void MtBin::mortaliate(const Environment::Step &env, unsigned int m, int max_species, int species_sim_thresh) {
   ///If there are no living salamanders, then don't do anything
   if(bin.empty()) return;
 
-  double mytemp = temp(tMyrs);  //Current temperature of bin
+  const double mytemp = env.temp[m];                  //Current temperature of bin
+  const double myarea = env.area[m];                  //Current area of bin
 
   if(alive()>30000){
     std::cerr<<"30ksals found in a bin. Killing the simulation."<<std::endl;
     throw std::runtime_error("30ksals found in a bin. Killing the simulation.");
   }
 
+  //For temperatures outside of these limits, all of the salamanders die. See
+  //Salamander::pDie()
+  if(!(0<=mytemp && mytemp<=50)){
+    killAll();
+    return;
+  }
+
+  //Scratch space reused between calls so that we do not allocate every time
+  static thread_local std::vector<int>           species_abundance;
+  static thread_local std::vector<double>        species_term;
+  static thread_local std::vector<double>        abundance_term;
+  static thread_local std::vector<double>        pdeath;
+  static thread_local std::vector<double>        uniforms;
+  static thread_local std::vector<unsigned char> dead;
+
+  const unsigned int n = bin.size();
+
   //If individuals have the same parent species they are part of the same
   //species. Cache this here to maintain O(N) operation
-  std::vector<int> species_abundance(max_species,0);
-  for(const auto &s: bin)
-    species_abundance.at(s.species)++;
-
-  //For each salamander, check to see if it dies
-  for(auto s=bin.begin();s!=bin.end();s++){
-    //These are both initially used to count individuals. Then area is divided
-    //to produce abundance.
-    double conspecific_abundance    = species_abundance[s->species]-1;
-    double heterospecific_abundance = bin.size()-species_abundance[s->species];
-
-    //Turn counts into abundances, as promised
-    conspecific_abundance    /= area(heightkm(), tMyrs);
-    heterospecific_abundance /= area(heightkm(), tMyrs);
-
-    //Now that we've calculated CA and HA, see if the salamander is affected by
-    //it.
-    if(s->pDie(mytemp, conspecific_abundance, heterospecific_abundance)){
-      killSalamander(s);
-      //If we kill a salamander, we swap the last living salamander in the list
-      //with the salamander we just killed. Therefore, we need to make sure that
-      //we still run the mortaliate function for the living salamander that now
-      //inhabits the spot that we just filled.
-      s--;
+  species_abundance.assign(max_species,0);
+  for(const auto &sp: bin.species)
+    species_abundance.at(sp)++;
+
+  //The original method visits the salamanders one at a time, removing each as
+  //it dies, so each salamander's heterospecific count depends on the deaths
+  //before it. See Params::mortalityAbundance()
+  if(params->mortalityAbundance()==MORTALITY_ABUNDANCE_LEGACY){
+    uniforms.resize(n);
+    uniform_rand_reals(uniforms.data(), n, 0, 1);
+    unsigned int visit = 0;
+    for(std::size_t s=0;s<bin.size();visit++){
+      const int sp = bin.species[s];
+      //As in the original, the heterospecific count is unsigned and wraps
+      //around once the bin is smaller than the species was
+      const double conspecific    = species_abundance[sp]-1;
+      const double heterospecific = bin.size()-species_abundance[sp];
+      const double term = conspecific   /myarea*params->logitCAweight()
+                         +heterospecific/myarea*params->logitHAweight();
+      double p;
+      DeathProbabilities(
+        &bin.otempdegC[s], &term, 1, mytemp,
+        params->logitOffset(), params->logitTempWeight(),
+        params->mortalityKernel(), &p
+      );
+      if(uniforms[visit]<p)
+        bin.swapRemove(s); //Position s now holds another salamander
+      else
+        s++;
     }
+    return;
   }
+
+  //The contribution of conspecific and heterospecific abundance to the logit is
+  //the same for every member of a species, so we calculate it once per species
+  //present in the bin. Counts are turned into abundances by dividing by area.
+  species_term.resize(max_species);
+  for(const auto &sp: bin.species)
+    species_term[sp] = (species_abundance[sp]-1)/myarea*params->logitCAweight()
+                      +(n-species_abundance[sp])/myarea*params->logitHAweight();
+
+  abundance_term.resize(n);
+  for(unsigned int s=0;s<n;s++)
+    abundance_term[s] = species_term[bin.species[s]];
+
+  //Evaluate the probability of death for the whole bin at once
+  pdeath.resize(n);
+  DeathProbabilities(
+    bin.otempdegC.data(), abundance_term.data(), n, mytemp,
+    params->logitOffset(), params->logitTempWeight(),
+    params->mortalityKernel(), pdeath.data()
+  );
+
+  //Kill each individual with probability pdeath
+  uniforms.resize(n);
+  uniform_rand_reals(uniforms.data(), n, 0, 1);
+
+  dead.resize(n);
+  for(unsigned int s=0;s<n;s++)
+    dead[s] = uniforms[s]<pdeath[s];
+
+  bin.removeFlagged(dead);
 }
 
 
@@ -134,10 +190,10 @@ void MtBin::breed(double tMyrs, int species_sim_thresh){
   if(bin.empty()) return;          //No one is alive here; there can be no breeding.
 
   //Maximum number of tries to find a pair to mate; prevents infinite loops.
-  int maxtries = TheParams.maxTriesToBreed();
+  int maxtries = params->maxTriesToBreed();
 
   //Maximum number of new offspring per bin per unit time
-  int max_babies = TheParams.maxOffspringPerBinPerDt();
+  int max_babies = params->maxOffspringPerBinPerDt();
 
   //randomSalamaner() chooses a salamander randomly in the range [0,maxsal].
   //Baby salamanders will be added at maxsal+1, maxsal+2, ... So, by noting
@@ -146,137 +202,404 @@ void MtBin::breed(double tMyrs, int species_sim_thresh){
   //salamanders be part of the same species at the beginning of the timestep.
   const int maxsal = bin.size()-1;
 
+  if(params->breedingMode()==BREEDING_BUCKETED){
+    breedBucketed(maxsal, maxtries, max_babies);
+    return;
+  }
+
   //As long as there's room in the bin, and we still have to make babies, and we
   //are not caught in an infinite loop, then try to make more babies.
   while(max_babies>0 && maxtries-->0){
-    auto parenta = randomSalamander(maxsal);
-    auto parentb = randomSalamander(maxsal);
+    const unsigned int parenta = randomSalamander(maxsal);
+    const unsigned int parentb = randomSalamander(maxsal);
     //If parents are genetically similar enough to be classed as the same
     //species based on species_sim_thresh, then they can breed.
-    if(parenta->species == parentb->species){
-      addSalamander(parenta->breed(*parentb));
+    if(bin.species[parenta] == bin.species[parentb]){
+      addSalamander(bin.get(parenta).breed(bin.get(parentb), *params));
       max_babies--;
     }
   }
 }
 
 
+//Breeding by rejection sampling (see breed()) picks two salamanders at random
+//and accepts them if they are of the same species. A species with n_k members
+//therefore produces a pair with probability (n_k/N)^2 on each try, and a try
+//succeeds with probability q = sum_k (n_k/N)^2. Here we reproduce that
+//distribution without the wasted tries: the number of babies is the number of
+//successes in maxtries tries, capped at max_babies, and each baby's species is
+//drawn with weight n_k^2, after which both parents are drawn from that species.
+void MtBin::breedBucketed(int maxsal, int maxtries, int max_babies){
+  if(maxtries<=0 || max_babies<=0) return;
+
+  //Scratch space reused between calls so that we do not allocate every time
+  static thread_local std::vector<int>          bucket_of;   //Species -> bucket, -1 if absent
+  static thread_local std::vector<int>          bucket_species;
+  static thread_local std::vector<unsigned int> bucket_start;
+  static thread_local std::vector<unsigned int> bucket_fill;
+  static thread_local std::vector<unsigned int> grouped;     //Salamanders grouped by species
+  static thread_local std::vector<double>       cumulative_weight;
+
+  const unsigned int n = maxsal+1;
+
+  //Count the members of each species present, numbering the species' buckets
+  //in the order in which they are first met. This and the pass below are
+  //O(n), rather than the O(n log n) of sorting the salamanders by species.
+  bucket_species.clear();
+  bucket_start.clear();
+  for(unsigned int s=0;s<n;s++){
+    const int sp = bin.species[s];
+    if((unsigned int)sp>=bucket_of.size())
+      bucket_of.resize(sp+1,-1);
+    if(bucket_of[sp]<0){
+      bucket_of[sp] = bucket_species.size();
+      bucket_species.push_back(sp);
+      bucket_start.push_back(0);
+    }
+    bucket_start[bucket_of[sp]]++;
+  }
+
+  //Turn the counts into the offsets at which each bucket starts and accumulate
+  //the weights
+  cumulative_weight.clear();
+  double total_weight = 0;
+  unsigned int offset = 0;
+  for(auto &start: bucket_start){
+    const double count = start;
+    total_weight += count*count;
+    cumulative_weight.push_back(total_weight);
+    start   = offset;
+    offset += count;
+  }
+  bucket_start.push_back(n);
+
+  //Place each salamander in its species' bucket, keeping them in bin order
+  bucket_fill.assign(bucket_start.begin(), bucket_start.end()-1);
+  grouped.resize(n);
+  for(unsigned int s=0;s<n;s++)
+    grouped[bucket_fill[bucket_of[bin.species[s]]]++] = s;
+
+  //Leave the map empty for the next call without walking all of it
+  for(const auto &sp: bucket_species)
+    bucket_of[sp] = -1;
+
+  //Number of successful tries out of maxtries, capped at max_babies
+  const double q = total_weight/((double)n*n);
+  std::binomial_distribution<int> successes(maxtries, std::min(q,1.0));
+  const int babies = std::min(max_babies, successes(rand_engine()));
+
+  for(int b=0;b<babies;b++){
+    //Choose a species with weight n_k^2
+    const double w = uniform_rand_real(0,total_weight);
+    unsigned int k = std::upper_bound(
+      cumulative_weight.begin(), cumulative_weight.end(), w
+    )-cumulative_weight.begin();
+    k = std::min<unsigned int>(k, cumulative_weight.size()-1); //Guard against rounding
+    const unsigned int first = bucket_start[k];
+    const unsigned int last  = bucket_start[k+1]-1;
+
+    //Choose both parents uniformly from within the species. As with rejection
+    //sampling, the same salamander may be chosen twice.
+    const unsigned int parenta = grouped[uniform_rand_int(first,last)];
+    const unsigned int parentb = grouped[uniform_rand_int(first,last)];
+    addSalamander(bin.get(parenta).breed(bin.get(parentb), *params));
+  }
+}
+
+
 //Move salamanders from this bin to a different bin
-void MtBin::moveSalamanderTo(const MtBin::container::iterator &s, MtBin &b){
-  b.addSalamander(*s); //Add salamander to the indicated bin
-  killSalamander(s);   //Remove the salamander from this bin
+void MtBin::moveSalamanderTo(unsigned int s, MtBin &b){
+  //Add salamander to the indicated bin and remove it from this one
+  bin.transferTo(s, b.bin);
+}
+
+
+//Choose the salamanders which consider dispersing. Each salamander is chosen
+//independently with probability prob, so the gaps between chosen salamanders
+//are geometrically distributed. Rather than drawing a random number for every
+//salamander, we draw one per chosen salamander and use it to skip ahead.
+void MtBin::dispersalCandidates(double prob, std::vector<unsigned int> &candidates) const {
+  candidates.clear();
+  for_each_bernoulli(bin.size(), prob, [&](std::size_t s){
+    candidates.push_back(s);
+  });
+}
+
+
+//Offer each salamander in this bin the opportunity to disperse with probability
+//prob. `disperse(s)` is called for each salamander which takes the opportunity
+//and returns true if salamander s left the bin.
+template<class F>
+void MtBin::forEachDisperser(double prob, F disperse){
+  if(bin.empty() || prob<=0) return;
+
+  if(params->dispersalSampling()==DISPERSAL_SAMPLING_GEOMETRIC){
+    static thread_local std::vector<unsigned int> candidates;
+    dispersalCandidates(prob, candidates);
+    //Candidates are visited from the back of the bin to the front. When a
+    //salamander leaves, its place is taken by the salamander at the back of the
+    //bin, which has already been considered, so no salamander is considered
+    //twice and none are missed.
+    for(auto c=candidates.rbegin();c!=candidates.rend();++c)
+      disperse(*c);
+  } else {
+    for(unsigned int s=0;s<bin.size();s++){
+      //Do I want to migrate?
+      if(uniform_rand_real(0,1)>=prob)
+        continue;
+      //If the salamander left, the salamander which took its place must still
+      //be considered
+      if(disperse(s))
+        s--;
+    }
+  }
 }
 
 
 //Give salamanders in this bin the opportunity to move to neighbouring bins if
 //advantageous
-void MtBin::diffuseToBetter(double tMyrs, MtBin *lower, MtBin *upper) {
+void MtBin::diffuseToBetter(const Environment::Step &env, unsigned int m, MtBin *lower, MtBin *upper) {
   if(bin.empty()) return;
 
-  for(container::iterator s=bin.begin();s!=bin.end();s++){
-    //Do I want to migrate?
-    if(uniform_rand_real(0,1)>=TheParams.dispersalProb())
-      continue;
+  const double mytemp = env.temp[m];
+
+  forEachDisperser(params->dispersalProb(), [&](unsigned int s){
+    const double otempdegC = bin.otempdegC[s];
 
     //Higher bins are cooler. If the salamander's optimal temperature is cooler
     //than the current bin and closer to the upper neighbour than the current
     //bin, the salamander tries to migrate up the mountain.
     if( upper
-        && s->otempdegC<temp(tMyrs)
-        && std::abs( s->otempdegC - upper->temp(tMyrs) ) 
-                              < std::abs( s->otempdegC - temp(tMyrs) )
-        && upper->heightkm()<heightMaxKm(tMyrs)
+        && otempdegC<mytemp
+        && std::abs( otempdegC - env.temp[m+1] ) 
+                              < std::abs( otempdegC - mytemp )
+        && !env.above_summit[m+1]
     ){
       moveSalamanderTo(s,*upper);
-      --s;
+      return true;
     //Lower bins are warmer. If the salamander's optimal temperature is warmer
     //than the current bin and closer to the lower neighbour than the current
     //bin, the salamander tries to migrate down the mountain.
     } else if(
         lower
-        && s->otempdegC>temp(tMyrs)
-        && std::abs( s->otempdegC - lower->temp(tMyrs) )
-                              < std::abs( s->otempdegC - temp(tMyrs) )
-        && lower->heightkm()<heightMaxKm(tMyrs)
+        && otempdegC>mytemp
+        && std::abs( otempdegC - env.temp[m-1] )
+                              < std::abs( otempdegC - mytemp )
+        && !env.above_summit[m-1]
     ){
       moveSalamanderTo(s,*lower);
-      --s;
+      return true;
     }
-  }
+    return false;
+  });
 }
 
 //Give salamanders in this bin the opportunity to move to neighbouring bins.
-void MtBin::diffuseLocal(double tMyrs, MtBin *lower, MtBin *upper) {
+void MtBin::diffuseLocal(const Environment::Step &env, unsigned int m, MtBin *lower, MtBin *upper) {
   if(bin.empty()) return;
 
-  for(container::iterator s=bin.begin();s!=bin.end();s++){
-    //Does the salamander want to migrate?
-    if(uniform_rand_real(0,1)>=TheParams.dispersalProb())
-      continue; //No
-
+  forEachDisperser(params->dispersalProb(), [&](unsigned int s){
     //Am I moving up or down? Be sure not to move off the bottom or top
     if(uniform_rand_real(0,1)>0.5){
-      if(upper && upper->heightkm()<heightMaxKm(tMyrs)){
+      if(upper && !env.above_summit[m+1]){
         moveSalamanderTo(s,*upper);
-        --s;
+        return true;
       }
     } else {
-      if(lower && lower->heightkm()<heightMaxKm(tMyrs)){
+      if(lower && !env.above_summit[m-1]){
         moveSalamanderTo(s,*lower);
-        --s;
+        return true;
       }
     }
-  }
+    return false;
+  });
 }
 
 
 //Method for moving salamanders into a special separate bin representing the
 //surrounding lowlands.
 void MtBin::diffuseToLowlands(MtBin &lowlands){
-  for(container::iterator s=bin.begin();s!=bin.end();s++){
-    //Do I want to migrate?
-    if(uniform_rand_real(0,1)>=TheParams.toLowlandsProb())
-      continue;
-
+  forEachDisperser(params->toLowlandsProb(), [&](unsigned int s){
     moveSalamanderTo(s,lowlands);
-    --s;
-  }
+    return true;
+  });
 }
 
 
 //Method to be used by the surrounding lowlands to move salamanders back into
 //the active simulation.
 void MtBin::diffuseFromLowlands(MtBin &frontrange){
-  for(container::iterator s=bin.begin();s!=bin.end();s++){
-    //Do I want to migrate?
-    if(uniform_rand_real(0,1)>=TheParams.fromLowlandsProb())
-      continue;
-
+  forEachDisperser(params->fromLowlandsProb(), [&](unsigned int s){
     moveSalamanderTo(s,frontrange);
-    --s;
-  }
+    return true;
+  });
 }
 
 
 
 //Give salamanders in this bin the opportunity to move all over
-void MtBin::diffuseGlobal(double tMyrs, std::vector<MtBin> &mts) {
+void MtBin::diffuseGlobal(const Environment::Step &env, std::vector<MtBin> &mts) {
   if(bin.empty()) return;
 
-  for(container::iterator s=bin.begin();s!=bin.end();s++){
-    //Do I want to migrate?
-    if(uniform_rand_real(0,1)>=TheParams.dispersalProb())
-      continue;
+  const double prob = params->dispersalProb();
 
-    int to_bin = -1;
+  forEachDisperser(prob, [&](unsigned int s){
     //Choose a bin to migrate to. Loop until the chosen bin is valid, in the
     //sense of not being above the top of the mountain.
-    while(to_bin==-1 || mts[to_bin].heightkm() >= heightMaxKm(tMyrs))
+    int to_bin = -1;
+    while(to_bin==-1 || env.above_summit[to_bin])
       to_bin = uniform_rand_int(0,mts.size()-1);
 
+    //A salamander which "moves" to its own bin stays put and is then offered
+    //the opportunity to migrate again.
+    while(&mts[to_bin]==this){
+      if(uniform_rand_real(0,1)>=prob)
+        return false;
+      to_bin = -1;
+      while(to_bin==-1 || env.above_summit[to_bin])
+        to_bin = uniform_rand_int(0,mts.size()-1);
+    }
+
     moveSalamanderTo(s,mts[to_bin]);
-    --s;
+    return true;
+  });
+}
+
+
+
+//Choose the salamanders which consider dispersing, in increasing order. With
+//geometric sampling only the chosen salamanders cost a random number.
+void MtBin::chooseDispersers(double prob, std::vector<unsigned int> &candidates){
+  if(params->dispersalSampling()==DISPERSAL_SAMPLING_GEOMETRIC){
+    dispersalCandidates(prob, candidates);
+    return;
   }
+  candidates.clear();
+  for(unsigned int s=0;s<bin.size();s++)
+    if(uniform_rand_real(0,1)<prob)
+      candidates.push_back(s);
+}
+
+
+//Offer each salamander in this bin the opportunity to disperse with probability
+//prob. `choose(s)` returns the destination of salamander s, or -1 if it stays.
+//Nothing moves while the emigrants are being chosen, so `choose` always sees
+//the bin as it was at the start. Afterwards the emigrants are copied into the
+//outbox, grouped by destination, and removed from the bin in a single pass.
+template<class F>
+void MtBin::fillOutbox(double prob, unsigned int ndest, F choose){
+  outbox.clear();
+  outbox_start.assign(ndest+1, 0);
+  if(bin.empty() || prob<=0) return;
+
+  static thread_local std::vector<unsigned int>  candidates;
+  static thread_local std::vector<unsigned int>  leaving;
+  static thread_local std::vector<std::uint64_t> by_dest;
+  chooseDispersers(prob, candidates);
+
+  leaving.clear();
+  by_dest.clear();
+  for(const auto s: candidates){
+    const int dest = choose(s);
+    if(dest<0)
+      continue;
+    assert((unsigned int)dest<ndest);
+    leaving.push_back(s);
+    //Packing the destination above the index lets a single sort group the
+    //emigrants by destination while keeping their order within each group
+    by_dest.push_back(((std::uint64_t)dest<<32) | s);
+    outbox_start[dest+1]++;
+  }
+  if(leaving.empty()) return;
+
+  std::sort(by_dest.begin(), by_dest.end());
+  for(unsigned int d=0;d<ndest;d++)
+    outbox_start[d+1] += outbox_start[d];
+
+  outbox.reserve(by_dest.size());
+  for(const auto x: by_dest)
+    outbox.pushFrom(bin, (unsigned int)(x & 0xFFFFFFFF));
+  bin.removeSorted(leaving);
+}
+
+
+//Outbox version of diffuseToBetter()
+void MtBin::emigrateToBetter(const Environment::Step &env, const std::vector<MtBin> &mts, unsigned int m){
+  const double mytemp = env.temp[m];
+
+  //A neighbour above the top of the mountain is never a destination
+  const bool   can_go_up    = m<mts.size()-1 && !env.above_summit[m+1];
+  const bool   can_go_down  = m>0            && !env.above_summit[m-1];
+  const double upper_temp   = can_go_up   ? env.temp[m+1] : 0;
+  const double lower_temp   = can_go_down ? env.temp[m-1] : 0;
+
+  fillOutbox(params->dispersalProb(), mts.size()+1, [&](unsigned int s){
+    const double otempdegC = bin.otempdegC[s];
+    if(can_go_up && otempdegC<mytemp
+        && std::abs(otempdegC-upper_temp)<std::abs(otempdegC-mytemp))
+      return (int)m+1;
+    if(can_go_down && otempdegC>mytemp
+        && std::abs(otempdegC-lower_temp)<std::abs(otempdegC-mytemp))
+      return (int)m-1;
+    return -1;
+  });
+}
+
+
+//Outbox version of diffuseLocal()
+void MtBin::emigrateLocal(const Environment::Step &env, const std::vector<MtBin> &mts, unsigned int m){
+  const bool can_go_up   = m<mts.size()-1 && !env.above_summit[m+1];
+  const bool can_go_down = m>0            && !env.above_summit[m-1];
+
+  fillOutbox(params->dispersalProb(), mts.size()+1, [&](unsigned int){
+    //Am I moving up or down? Be sure not to move off the bottom or top
+    if(uniform_rand_real(0,1)>0.5)
+      return can_go_up   ? (int)m+1 : -1;
+    else
+      return can_go_down ? (int)m-1 : -1;
+  });
+}
+
+
+//Outbox version of diffuseGlobal()
+void MtBin::emigrateGlobal(const Environment::Step &env, const std::vector<MtBin> &mts, unsigned int m){
+  const double prob = params->dispersalProb();
+
+  fillOutbox(prob, mts.size()+1, [&](unsigned int){
+    //Choose a bin to migrate to. Loop until the chosen bin is valid, in the
+    //sense of not being above the top of the mountain.
+    int to_bin = -1;
+    while(to_bin==-1 || env.above_summit[to_bin])
+      to_bin = uniform_rand_int(0,mts.size()-1);
+
+    //A salamander which "moves" to its own bin stays put and is then offered
+    //the opportunity to migrate again.
+    while((unsigned int)to_bin==m){
+      if(uniform_rand_real(0,1)>=prob)
+        return -1;
+      to_bin = -1;
+      while(to_bin==-1 || env.above_summit[to_bin])
+        to_bin = uniform_rand_int(0,mts.size()-1);
+    }
+
+    return to_bin;
+  });
+}
+
+
+//Outbox version of diffuseToLowlands() and diffuseFromLowlands()
+void MtBin::emigrateTo(double prob, unsigned int dest, unsigned int ndest, unsigned int residents){
+  fillOutbox(prob, ndest, [&](unsigned int s){
+    return s<residents ? (int)dest : -1;
+  });
+}
+
+
+//Bulk-append the salamanders in source's outbox which are bound for this bin
+void MtBin::immigrateFrom(const MtBin &source, unsigned int dest){
+  //The source has not filled its outbox for destinations this far along
+  if(dest+1>=source.outbox_start.size()) return;
+  bin.append(source.outbox, source.outbox_start[dest], source.outbox_start[dest+1]);
 }
 
 
@@ -284,7 +607,7 @@ void MtBin::diffuseGlobal(double tMyrs, std::vector<MtBin> &mts) {
 ///Given a time tMyrs in millions of years ago returns area at that elevation
 ///IN SQUARE KILOMETERS
 double MtBin::area(double elevationkm, double tMyrs) const {
-  if(!TheParams.pVaryHeight()) tMyrs=65;
+  if(!params->pVaryHeight()) tMyrs=65;
 
   ///Constants defining a normal distribution that describes area available at
   ///different height bands in the Appalachian mountains. Parameters are fit to
@@ -317,27 +640,29 @@ double MtBin::area(double elevationkm, double tMyrs) const {
 }
 
 void MtBin::killAll() {
-  for(auto s=bin.begin();s!=bin.end();s++){
-    killSalamander(s);
-    //If we kill a salamander, we swap the last living salamander in the list
-    //with the salamander we just killed. Therefore, we need to make sure that
-    //we still run the mortaliate function for the living salamander that now
-    //inhabits the spot that we just filled.
-    s--;
-  }
+  //Every salamander dies, so there is no need to swap them out one at a time
+  bin.clear();
 }
 
 
 //Choose a random salamander [0,maxsal] from the bin
-MtBin::container::iterator MtBin::randomSalamander(int maxsal){
+unsigned int MtBin::randomSalamander(int maxsal){
   //Cannot run this on an empty bin
   assert(!bin.empty());
-  //Generate an iterator to the beginning of the bin
-  std::vector<Salamander>::iterator temp = bin.begin();
   //Choose a random member of the bin
-  int pos=uniform_rand_int(0, maxsal);
-  //Advance the iterator so that it points at this member
-  std::advance(temp,pos);
-  //Return the iterator
-  return temp;
-}
\ No newline at end of file
+  return uniform_rand_int(0, maxsal);
+}
+
+
+void MtBin::save(std::ostream &out) const {
+  WriteBinary(out, heightkm_val);
+  bin.save(out);
+  rng.save(out);
+}
+
+
+void MtBin::load(std::istream &in){
+  ReadBinary(in, heightkm_val);
+  bin.load(in);
+  rng.load(in);
+}
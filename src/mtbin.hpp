@@ -6,32 +6,51 @@
 
 #include <vector>
 #include "salamander.hpp"
+#include "population.hpp"
 #include "params.hpp"
+#include "random.hpp"
+#include "environment.hpp"
 
 class MtBin {
  public:
 	///Alias for the type of container we are using to store the salamanders
-	///used in this bin
-	typedef std::vector<Salamander> container;
+	///used in this bin. The salamanders are stored as a structure of arrays so
+	///that loops touching only one property do not drag the others through the
+	///cache.
+	typedef Population container;
 
 	///Define the bin used to store the salamanders
 	container bin;
 
+	///Stream from which this bin's random numbers are drawn. Giving each bin its
+	///own stream allows bins to be processed in parallel without the results
+	///depending on the number of threads.
+	RandomStream rng;
+
+	///Salamanders which have decided to leave this bin but have not yet
+	///arrived at their destinations, grouped by destination. Those bound for
+	///destination d are outbox[outbox_start[d],outbox_start[d+1]). Destinations
+	///are numbered by index into the simulation's bins, with the lowlands
+	///numbered one past the last bin. Used by DISPERSAL_STAGE_OUTBOX.
+	container                 outbox;
+	std::vector<unsigned int> outbox_start;
+
 	MtBin();
 
-	///Initializes this bin with elevation specified by heightkm0
-	MtBin(double heightkm);
+	///Initializes this bin with elevation specified by heightkm0. The bin reads
+	///the parameters of its simulation from params, which must outlive it.
+	MtBin(double heightkm, const Params &params);
 
 	///Returns the height of this bin IN KILOMETERS
 	double heightkm() const;
 
 	///Returns the maximum height of the mountain range at the given time
-	static double heightMaxKm(double tMyrs);
+	static double heightMaxKm(double tMyrs, const Params &params);
 
 	///Apply mortality to salamander within this bin based on how far they
 	///differ from optimal temperature and also on the the carrying capacity of
-	///the bin.
-	void mortaliate(double tMyrs, int max_species, int species_sim_thresh);
+	///the bin. This bin is bin m of the environment env.
+	void mortaliate(const Environment::Step &env, unsigned int m, int max_species, int species_sim_thresh);
 
 	///Return the temperature of the bin at a given time, based on conditions at
 	///time tMyrs, in millions of year
@@ -55,14 +74,14 @@ class MtBin {
 	void breed(double tMyrs, int species_sim_thresh);
 
 	///Salamanders have the opportunity to move up or down the mountain if
-	///advantageous
-	void diffuseToBetter(double tMyrs, MtBin *lower, MtBin *upper);
+	///advantageous. This bin is bin m of the environment env.
+	void diffuseToBetter(const Environment::Step &env, unsigned int m, MtBin *lower, MtBin *upper);
 
 	///Salamanders have the opportunity to move up or down the mountain
-	void diffuseLocal(double tMyrs, MtBin *lower, MtBin *upper);
+	void diffuseLocal(const Environment::Step &env, unsigned int m, MtBin *lower, MtBin *upper);
 
 	///Salamanders have the opportunity to move all over the mountain
-	void diffuseGlobal(double tMyrs, std::vector<MtBin> &mts);
+	void diffuseGlobal(const Environment::Step &env, std::vector<MtBin> &mts);
 
 	///Kills all of the salamanders in the bin
 	void killAll();
@@ -75,21 +94,79 @@ class MtBin {
 	//the active simulation.
 	void diffuseFromLowlands(MtBin &frontrange);
 
-	///Fetch an iterator to a random salamander from this bin
-	container::iterator randomSalamander(int maxsal);
+	///Outbox versions of diffuseToBetter(), diffuseLocal(), and
+	///diffuseGlobal(). Moves the salamanders which decide to leave this bin, the
+	///m-th of mts, into the outbox. Only the heights and temperatures of the
+	///other bins are read, so all bins may decide at the same time.
+	void emigrateToBetter(const Environment::Step &env, const std::vector<MtBin> &mts, unsigned int m);
+	void emigrateLocal   (const Environment::Step &env, const std::vector<MtBin> &mts, unsigned int m);
+	void emigrateGlobal  (const Environment::Step &env, const std::vector<MtBin> &mts, unsigned int m);
+
+	///Outbox version of diffuseToLowlands() and diffuseFromLowlands(). Each
+	///salamander leaves for destination dest with probability prob. ndest is
+	///the number of destinations. Only salamanders [0,residents) may leave.
+	void emigrateTo(double prob, unsigned int dest, unsigned int ndest, unsigned int residents);
+
+	///Appends the salamanders in source's outbox which are bound for this bin,
+	///destination dest, to this bin
+	void immigrateFrom(const MtBin &source, unsigned int dest);
+
+	///Fills candidates with the indices, in increasing order, of the
+	///salamanders which consider dispersing when each does so with probability
+	///prob. Uses geometric skips, so only one random number is drawn per
+	///candidate.
+	void dispersalCandidates(double prob, std::vector<unsigned int> &candidates) const;
+
+	///Fetch the index of a random salamander from this bin
+	unsigned int randomSalamander(int maxsal);
+
+	///Writes the bin's salamanders, height, and random number stream to a
+	///checkpoint. The outbox is not written, since it is emptied and refilled
+	///within each timestep. See checkpoint.hpp.
+	void save(std::ostream &out) const;
+
+	///Restores a bin written by save(). The bin keeps its parameters.
+	void load(std::istream &in);
 
  private:
 	///Kills the indicated salamander by swapping it to the end of bin and then
-	///popping the back of bin. When used with an iterator, the iterator MUST
-	///decrement itself and then advance so that the swapped salamander is
-	///considered.
-	void killSalamander(container::iterator s);
-
-	///Safely transfers salamander s from here to b
-	void moveSalamanderTo(const MtBin::container::iterator &s, MtBin &b);
+	///popping the back of bin. When used in a loop, the loop MUST consider the
+	///same index again so that the swapped salamander is considered.
+	void killSalamander(unsigned int s);
+
+	///Safely transfers salamander s from here to b. As with killSalamander(),
+	///index s now holds a different salamander.
+	void moveSalamanderTo(unsigned int s, MtBin &b);
+
+	///Offers each salamander the opportunity to disperse with probability prob
+	///and calls disperse(s) for each which takes it. disperse() returns true if
+	///salamander s left the bin. See Params::dispersalSampling() for how the
+	///dispersers are chosen.
+	template<class F>
+	void forEachDisperser(double prob, F disperse);
+
+	///Fills candidates with the indices, in increasing order, of the
+	///salamanders which consider dispersing, chosen as directed by
+	///Params::dispersalSampling()
+	void chooseDispersers(double prob, std::vector<unsigned int> &candidates);
+
+	///Offers each salamander the opportunity to disperse with probability prob.
+	///choose(s) returns the destination of salamander s, or -1 if it stays.
+	///Those which leave are moved into the outbox, grouped by destination.
+	template<class F>
+	void fillOutbox(double prob, unsigned int ndest, F choose);
+
+	///Breeds salamanders [0,maxsal] by drawing the number of babies and then
+	///each baby's species and parents directly. Produces the same distribution
+	///of offspring as the rejection sampling in breed(). See
+	///Params::breedingMode().
+	void breedBucketed(int maxsal, int maxtries, int max_babies);
 
 	///Height of this bin above sealevel across all times IN KILOMETERS
 	double heightkm_val;
+
+	///Parameters of the simulation this bin is part of
+	const Params *params;
 };
 
 #endif
@@ -1,7 +1,10 @@
 #include <fstream>
 #include <iostream>
 #include <stdexcept>
+#include <cmath>
+#include <sstream>
 #include "params.hpp"
+#include "checkpoint.hpp"
 
 Params::Params(){}
 
@@ -63,6 +66,213 @@ void Params::load(std::string filename){
 
   to_lowlands_prob   = Input_Double(fparam,"ToLowlandsProb");
   from_lowlands_prob = Input_Double(fparam,"FromLowlandsProb");
+
+  {
+    std::string temp = Input_Filename(fparam,"MortalityKernel");
+    if(temp=="Exact")
+      mortality_kernel = MORTALITY_EXACT;
+    else if(temp=="FastSigmoid")
+      mortality_kernel = MORTALITY_FAST_SIGMOID;
+    else {
+      std::cerr<<"Unrecognised mortality kernel! Expected: Exact, FastSigmoid"<<std::endl;
+      throw std::runtime_error("Unrecognised mortality kernel! Expected: Exact, FastSigmoid");
+    }
+  }
+
+  {
+    std::string temp = Input_Filename(fparam,"DispersalSampling");
+    if(temp=="PerIndividual")
+      dispersal_sampling = DISPERSAL_SAMPLING_PER_INDIVIDUAL;
+    else if(temp=="Geometric")
+      dispersal_sampling = DISPERSAL_SAMPLING_GEOMETRIC;
+    else {
+      std::cerr<<"Unrecognised dispersal sampling! Expected: PerIndividual, Geometric"<<std::endl;
+      throw std::runtime_error("Unrecognised dispersal sampling! Expected: PerIndividual, Geometric");
+    }
+  }
+
+  {
+    std::string temp = Input_Filename(fparam,"BreedingMode");
+    if(temp=="Rejection")
+      breeding_mode = BREEDING_REJECTION;
+    else if(temp=="Bucketed")
+      breeding_mode = BREEDING_BUCKETED;
+    else {
+      std::cerr<<"Unrecognised breeding mode! Expected: Rejection, Bucketed"<<std::endl;
+      throw std::runtime_error("Unrecognised breeding mode! Expected: Rejection, Bucketed");
+    }
+  }
+
+  bin_threads = Input_Integer(fparam,"BinThreads");
+  if(bin_threads<1){
+    std::cerr<<"BinThreads must be at least 1!"<<std::endl;
+    throw std::runtime_error("BinThreads must be at least 1!");
+  }
+
+  {
+    std::string temp = Input_Filename(fparam,"DispersalStage");
+    if(temp=="Immediate")
+      dispersal_stage = DISPERSAL_STAGE_IMMEDIATE;
+    else if(temp=="Outbox")
+      dispersal_stage = DISPERSAL_STAGE_OUTBOX;
+    else {
+      std::cerr<<"Unrecognised dispersal stage! Expected: Immediate, Outbox"<<std::endl;
+      throw std::runtime_error("Unrecognised dispersal stage! Expected: Immediate, Outbox");
+    }
+  }
+
+  newick_extant_only = Input_YesNo(fparam,"NewickExtantOnly");
+
+  {
+    std::string temp = Input_Filename(fparam,"StatsRecording");
+    if(temp=="All")
+      stats_recording = STATS_RECORD_ALL;
+    else if(temp=="Window")
+      stats_recording = STATS_RECORD_WINDOW;
+    else if(temp=="FinalStep")
+      stats_recording = STATS_RECORD_FINAL_STEP;
+    else {
+      std::cerr<<"Unrecognised stats recording! Expected: All, Window, FinalStep"<<std::endl;
+      throw std::runtime_error("Unrecognised stats recording! Expected: All, Window, FinalStep");
+    }
+  }
+
+  stats_window_start = Input_Double (fparam,"StatsWindowStart");
+  stats_window_end   = Input_Double (fparam,"StatsWindowEnd");
+  stats_stride       = Input_Integer(fparam,"StatsStride");
+  if(stats_stride<1){
+    std::cerr<<"StatsStride must be at least 1!"<<std::endl;
+    throw std::runtime_error("StatsStride must be at least 1!");
+  }
+
+  prune_check_interval = Input_Double (fparam,"PruneCheckInterval");
+  prune_min_alive      = Input_Integer(fparam,"PruneMinAlive");
+  prune_max_alive      = Input_Integer(fparam,"PruneMaxAlive");
+  prune_min_species    = Input_Integer(fparam,"PruneMinSpecies");
+  prune_max_species    = Input_Integer(fparam,"PruneMaxSpecies");
+  prune_max_ecdf       = Input_Double (fparam,"PruneMaxECDF");
+  prune_ecdf_start     = Input_Double (fparam,"PruneECDFStart");
+  prune_max_seconds    = Input_Double (fparam,"PruneMaxSeconds");
+  prune_max_steps      = Input_Integer(fparam,"PruneMaxSteps");
+  if(prune_check_interval<0 || prune_max_seconds<0 || prune_max_steps<0){
+    std::cerr<<"PruneCheckInterval, PruneMaxSeconds and PruneMaxSteps must not be negative!"<<std::endl;
+    throw std::runtime_error("PruneCheckInterval, PruneMaxSeconds and PruneMaxSteps must not be negative!");
+  }
+
+  checkpoint_interval = Input_Double  (fparam,"CheckpointInterval");
+  checkpoint_prefix   = Input_Filename(fparam,"CheckpointPrefix");
+  if(checkpoint_interval<0){
+    std::cerr<<"CheckpointInterval must not be negative!"<<std::endl;
+    throw std::runtime_error("CheckpointInterval must not be negative!");
+  }
+
+  fork_time     = Input_Double  (fparam,"ForkTime");
+  fork_snapshot = Input_Filename(fparam,"ForkSnapshot");
+  if(fork_time<0 || fork_time>=65){
+    std::cerr<<"ForkTime must be in [0,65)!"<<std::endl;
+    throw std::runtime_error("ForkTime must be in [0,65)!");
+  }
+
+  {
+    std::string temp = Input_Filename(fparam,"MortalityAbundance");
+    if(temp=="Legacy")
+      mortality_abundance = MORTALITY_ABUNDANCE_LEGACY;
+    else if(temp=="StartOfStep")
+      mortality_abundance = MORTALITY_ABUNDANCE_START_OF_STEP;
+    else {
+      std::cerr<<"Unrecognised mortality abundance! Expected: Legacy, StartOfStep"<<std::endl;
+      throw std::runtime_error("Unrecognised mortality abundance! Expected: Legacy, StartOfStep");
+    }
+  }
+}
+
+
+
+
+double Params::set(const std::string &param_name, double value){
+  const int ivalue = (int)std::lround(value);
+  if     (param_name=="NumBins"                ) value = numbins_val                  = ivalue;
+  else if(param_name=="MutationProb"           ) value = mutation_probability         = value;
+  else if(param_name=="TemperatureDrift"       ) value = temperature_drift_sd         = value;
+  else if(param_name=="SpeciesSimilarity"      ) value = species_sim_thresh           = ivalue;
+  else if(param_name=="timestep"               ) value = timestep_val                 = value;
+  else if(param_name=="DispersalProb"          ) value = dispersal_prob               = value;
+  else if(param_name=="InitialAltitude"        ) value = initial_altitude             = ivalue;
+  else if(param_name=="InitialPopSize"         ) value = initial_pop_size             = ivalue;
+  else if(param_name=="LogitTempWeight"        ) value = logit_temp_weight            = value;
+  else if(param_name=="LogitOffset"            ) value = logit_offset                 = value;
+  else if(param_name=="LogitCAweight"          ) value = logit_ca_weight              = value;
+  else if(param_name=="LogitHAweight"          ) value = logit_ha_weight              = value;
+  else if(param_name=="MaxOffspringPerBinPerDt") value = max_offspring_per_bin_per_dt = ivalue;
+  else if(param_name=="MaxTriesToBreed"        ) value = max_tries_to_breed           = ivalue;
+  else if(param_name=="ToLowlandsProb"         ) value = to_lowlands_prob             = value;
+  else if(param_name=="FromLowlandsProb"       ) value = from_lowlands_prob           = value;
+  else {
+    std::cerr<<"Parameter '"<<param_name<<"' cannot be varied!"<<std::endl;
+    throw std::runtime_error("Parameter cannot be varied!");
+  }
+
+  if(timestep_val<0.001){
+    std::cerr<<"Timestep too small!"<<std::endl;
+    throw std::runtime_error("Timestep too small!");
+  }
+
+  return value;
+}
+
+
+
+
+//The parameters are written out as a checkpoint would write them and the
+//bytes hashed with 64-bit FNV-1a
+std::uint64_t Params::digest() const {
+  std::ostringstream out;
+  WriteBinary(out, vary_height);
+  WriteBinary(out, vary_temp);
+  WriteBinary(out, numbins_val);
+  WriteBinary(out, mutation_probability);
+  WriteBinary(out, temperature_drift_sd);
+  WriteBinary(out, species_sim_thresh);
+  WriteBinary(out, timestep_val);
+  WriteBinary(out, dispersal_prob);
+  WriteBinary(out, dispersal_type);
+  WriteBinary(out, temp_series_filename);
+  WriteBinary(out, initial_altitude);
+  WriteBinary(out, initial_pop_size);
+  WriteBinary(out, logit_temp_weight);
+  WriteBinary(out, logit_offset);
+  WriteBinary(out, logit_ca_weight);
+  WriteBinary(out, logit_ha_weight);
+  WriteBinary(out, max_offspring_per_bin_per_dt);
+  WriteBinary(out, max_tries_to_breed);
+  WriteBinary(out, to_lowlands_prob);
+  WriteBinary(out, from_lowlands_prob);
+  WriteBinary(out, mortality_kernel);
+  WriteBinary(out, mortality_abundance);
+  WriteBinary(out, dispersal_sampling);
+  WriteBinary(out, breeding_mode);
+  WriteBinary(out, dispersal_stage);
+  WriteBinary(out, stats_recording);
+  WriteBinary(out, stats_window_start);
+  WriteBinary(out, stats_window_end);
+  WriteBinary(out, stats_stride);
+  WriteBinary(out, prune_check_interval);
+  WriteBinary(out, prune_min_alive);
+  WriteBinary(out, prune_max_alive);
+  WriteBinary(out, prune_min_species);
+  WriteBinary(out, prune_max_species);
+  WriteBinary(out, prune_max_ecdf);
+  WriteBinary(out, prune_ecdf_start);
+  WriteBinary(out, prune_max_seconds);
+  WriteBinary(out, prune_max_steps);
+  WriteBinary(out, fork_time);
+
+  std::uint64_t hash = 14695981039346656037ULL;
+  for(const unsigned char c: out.str()){
+    hash ^= c;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
 }
 
 
@@ -136,6 +346,30 @@ int         Params::numBins                 () const {return numbins_val;
 int         Params::initialPopSize          () const {return initial_pop_size;             }
 double      Params::toLowlandsProb          () const {return to_lowlands_prob;             }
 double      Params::fromLowlandsProb        () const {return from_lowlands_prob;           }
+int         Params::mortalityKernel         () const {return mortality_kernel;             }
+int         Params::dispersalSampling       () const {return dispersal_sampling;           }
+int         Params::breedingMode            () const {return breeding_mode;                }
+int         Params::binThreads              () const {return bin_threads;                  }
+int         Params::dispersalStage          () const {return dispersal_stage;              }
+bool        Params::newickExtantOnly        () const {return newick_extant_only;           }
+int         Params::statsRecording          () const {return stats_recording;              }
+double      Params::statsWindowStart        () const {return stats_window_start;           }
+double      Params::statsWindowEnd          () const {return stats_window_end;             }
+int         Params::statsStride             () const {return stats_stride;                 }
+double      Params::pruneCheckInterval      () const {return prune_check_interval;         }
+int         Params::pruneMinAlive           () const {return prune_min_alive;              }
+int         Params::pruneMaxAlive           () const {return prune_max_alive;              }
+int         Params::pruneMinSpecies         () const {return prune_min_species;            }
+int         Params::pruneMaxSpecies         () const {return prune_max_species;            }
+double      Params::pruneMaxECDF            () const {return prune_max_ecdf;               }
+double      Params::pruneECDFStart          () const {return prune_ecdf_start;             }
+double      Params::pruneMaxSeconds         () const {return prune_max_seconds;            }
+int         Params::pruneMaxSteps           () const {return prune_max_steps;              }
+double      Params::checkpointInterval      () const {return checkpoint_interval;          }
+std::string Params::checkpointPrefix        () const {return checkpoint_prefix;            }
+double      Params::forkTime                () const {return fork_time;                    }
+std::string Params::forkSnapshotFilename    () const {return fork_snapshot;                }
+int         Params::mortalityAbundance      () const {return mortality_abundance;          }
 bool        Params::debug                   () const {return debug_val;                    }
 
 
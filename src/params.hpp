@@ -2,11 +2,31 @@
 #define _sal_params_
 
 #include <fstream>
+#include <cstdint>
 
 const int DISPERSAL_BETTER      = 1;
 const int DISPERSAL_MAYBE_WORSE = 2;
 const int DISPERSAL_GLOBAL      = 3;
 
+const int DISPERSAL_SAMPLING_PER_INDIVIDUAL = 1;
+const int DISPERSAL_SAMPLING_GEOMETRIC      = 2;
+
+const int DISPERSAL_STAGE_IMMEDIATE = 1;
+const int DISPERSAL_STAGE_OUTBOX    = 2;
+
+const int STATS_RECORD_ALL        = 1;
+const int STATS_RECORD_WINDOW     = 2;
+const int STATS_RECORD_FINAL_STEP = 3;
+
+const int BREEDING_REJECTION = 1;
+const int BREEDING_BUCKETED  = 2;
+
+const int MORTALITY_EXACT        = 1;
+const int MORTALITY_FAST_SIGMOID = 2;
+
+const int MORTALITY_ABUNDANCE_LEGACY        = 1;
+const int MORTALITY_ABUNDANCE_START_OF_STEP = 2;
+
 class Params {
  private:
   void        Input_CheckParamName(std::ifstream &fparam, const std::string &param_name) const;
@@ -119,10 +139,138 @@ class Params {
   ///values turn this effect off.
   double from_lowlands_prob;
 
+  ///How the salamanders' probability of death is evaluated. Options are
+  ///MORTALITY_EXACT (the logit curve is evaluated using the standard library's
+  ///exponential) or MORTALITY_FAST_SIGMOID (a polynomial approximation of the
+  ///exponential whose error is bounded by FAST_SIGMOID_MAX_ERROR). See
+  ///mortality.hpp
+  int mortality_kernel;
+
+  ///How the salamanders which consider dispersing (including to and from the
+  ///lowlands) are chosen. DISPERSAL_SAMPLING_PER_INDIVIDUAL draws a random
+  ///number for every salamander. DISPERSAL_SAMPLING_GEOMETRIC draws the gaps
+  ///between chosen salamanders from a geometric distribution, so only one
+  ///random number is drawn per chosen salamander. Both choose each salamander
+  ///independently with the same probability.
+  int dispersal_sampling;
+
+  ///How mates are chosen. BREEDING_REJECTION picks random pairs and rejects
+  ///those of different species, up to max_tries_to_breed times; this is the
+  ///original method. BREEDING_BUCKETED groups each bin's salamanders by species
+  ///and draws the number of offspring, their species, and their parents
+  ///directly, giving the same distribution without the rejected tries.
+  int breeding_mode;
+
+  ///Number of threads used to process the bins of a single simulation. Each
+  ///bin draws from its own random number stream, so results do not depend on
+  ///this value. Values greater than 1 nest this parallelism inside the
+  ///parallelism across simulations.
+  int bin_threads;
+
+  ///How dispersal is carried out. DISPERSAL_STAGE_IMMEDIATE moves each
+  ///salamander as soon as it decides to leave, so a salamander may move several
+  ///bins in one step depending on the order in which bins are visited; this is
+  ///the original method. DISPERSAL_STAGE_OUTBOX has every bin decide its
+  ///emigrants, based on the bins as they were at the start of dispersal, into
+  ///outboxes grouped by destination. The outboxes are then emptied into their
+  ///destinations. Salamanders move at most once per step, counting the
+  ///exchange with the lowlands, and the result does not depend on the order in
+  ///which bins are visited.
+  int dispersal_stage;
+
+  ///If this is set to true, the phylogeny file contains only the species alive
+  ///at the end of each simulation and their ancestry. Otherwise every species
+  ///which ever existed is included.
+  bool newick_extant_only;
+
+  ///When species' statistics are recorded. STATS_RECORD_ALL records them at
+  ///every timestep. STATS_RECORD_WINDOW records them every stats_stride-th
+  ///timestep between stats_window_start and stats_window_end (inclusive, in
+  ///millions of years); if the window reaches 65, the last timestep of the
+  ///simulation is always recorded. STATS_RECORD_FINAL_STEP records them only
+  ///at the last timestep of the simulation. Statistics which are not recorded
+  ///are never stored.
+  int    stats_recording;
+  double stats_window_start;
+  double stats_window_end;
+  int    stats_stride;
+
+  ///Rules for stopping a simulation early and recording it as pruned, so that
+  ///time is not spent finishing simulations which will be discarded. Every
+  ///prune_check_interval millions of years (never if 0) the simulation is
+  ///pruned if the number of living salamanders lies outside
+  ///[prune_min_alive,prune_max_alive] or the number of living species outside
+  ///[prune_min_species,prune_max_species]; a maximum of 0 means no bound. From
+  ///prune_ecdf_start onwards, it is also pruned at these checks if the ECDF
+  ///score of the species alive at the time, a projection of the final score,
+  ///exceeds prune_max_ecdf (never if negative). At every timestep the
+  ///simulation is pruned once it has run for prune_max_seconds of wall-clock
+  ///time or prune_max_steps timesteps (neither if 0). Pruning on wall-clock
+  ///time makes the results depend on the speed of the machine.
+  double prune_check_interval;
+  int    prune_min_alive;
+  int    prune_max_alive;
+  int    prune_min_species;
+  int    prune_max_species;
+  double prune_max_ecdf;
+  double prune_ecdf_start;
+  double prune_max_seconds;
+  int    prune_max_steps;
+
+  ///Every checkpoint_interval millions of years (never if 0) each simulation
+  ///saves its full state to the file <checkpoint_prefix>_<run number>.ckpt. A
+  ///simulation which finds its checkpoint file when it starts resumes from it,
+  ///and goes on to produce exactly the results it would have had it never
+  ///stopped, so an interrupted ensemble can be finished by running it again.
+  ///A checkpoint is only resumed by a simulation with the same run number,
+  ///parameters, and global seed as the one which made it; any other
+  ///simulation refuses it. A simulation's checkpoint file is deleted once the
+  ///simulation finishes.
+  double      checkpoint_interval;
+  std::string checkpoint_prefix;
+
+  ///If fork_time is greater than 0, the simulations of the ensemble share
+  ///their history up to fork_time millions of years and differ only after it.
+  ///The shared history is simulated once, with the base parameters, and saved
+  ///to fork_snapshot; if fork_snapshot already exists, it is used instead,
+  ///provided it was made with the same base parameters and global seed.
+  ///Each simulation then continues from a copy of the shared history with its
+  ///own random number streams and its own parameters, which a sweep may vary.
+  ///The number of bins cannot be varied.
+  double      fork_time;
+  std::string fork_snapshot;
+
+  ///How the abundances which affect the salamanders' probability of death are
+  ///counted. MORTALITY_ABUNDANCE_LEGACY is the original method: salamanders
+  ///are visited one at a time and removed as they die, and the heterospecific
+  ///count is the bin's current size less the species' size at the start of
+  ///the step. That count is unsigned, so once a death leaves the bin smaller
+  ///than the species was, it wraps around to an enormous value and, for a
+  ///positive LogitHAweight, the rest of the bin dies; in a bin holding a
+  ///single species, the first death kills the whole bin. Published results
+  ///were made this way. MORTALITY_ABUNDANCE_START_OF_STEP counts both
+  ///abundances from the bin as it was at the start of the step, so the result
+  ///does not depend on the order of the salamanders and the whole bin is
+  ///evaluated at once. Far more salamanders survive: 100 newly placed clones
+  ///of Eve leave about 90 survivors rather than about 9.
+  int mortality_abundance;
+
  public:
   Params();
   void load(std::string filename);
 
+  ///Sets the named parameter to value. Only the numeric parameters which
+  ///describe a simulation itself can be set this way; these are the ones a
+  ///Sweep may vary. Integer parameters are rounded to the nearest integer.
+  ///Returns the value the parameter was set to.
+  double set(const std::string &param_name, double value);
+
+  ///Returns a digest of the parameters which affect the course of a
+  ///simulation, so that checkpoints can be matched to the parameters which
+  ///made them. The names of output files, the number of realizations and
+  ///threads, the checkpointing parameters, and the seed are left out.
+  std::uint64_t digest() const;
+
   //A large number of access methods which return the above variables
   std::string outSummaryFilename      () const;
   std::string outPersistFilename      () const;
@@ -152,6 +300,30 @@ class Params {
   int         maxTriesToBreed         () const;
   double      toLowlandsProb          () const;
   double      fromLowlandsProb        () const;
+  int         mortalityKernel         () const;
+  int         dispersalSampling       () const;
+  int         breedingMode            () const;
+  int         binThreads              () const;
+  int         dispersalStage          () const;
+  bool        newickExtantOnly        () const;
+  int         statsRecording          () const;
+  double      statsWindowStart        () const;
+  double      statsWindowEnd          () const;
+  int         statsStride             () const;
+  double      pruneCheckInterval      () const;
+  int         pruneMinAlive           () const;
+  int         pruneMaxAlive           () const;
+  int         pruneMinSpecies         () const;
+  int         pruneMaxSpecies         () const;
+  double      pruneMaxECDF            () const;
+  double      pruneECDFStart          () const;
+  double      pruneMaxSeconds         () const;
+  int         pruneMaxSteps           () const;
+  double      checkpointInterval      () const;
+  std::string checkpointPrefix        () const;
+  double      forkTime                () const;
+  std::string forkSnapshotFilename    () const;
+  int         mortalityAbundance      () const;
   bool        debug                   () const;
 };
 
@@ -1,14 +1,18 @@
 #include "phylo.hpp"
 #include "salamander.hpp"
 #include "mtbin.hpp"
+#include "checkpoint.hpp"
 #include <cstdlib>
-#include <set>
 #include <cassert>
 #include <algorithm>
 #include <fstream>
 #include <string>
 #include <iostream>
 #include <cmath>
+#include <cstdio>
+#include <cstdint>
+#include <exception>
+#include <limits>
 
 PhyloNode::PhyloNode(const Salamander &s, double t){
   //Copy relevant parameters from the Salamander that originates this strain
@@ -18,12 +22,10 @@ PhyloNode::PhyloNode(const Salamander &s, double t){
   //Set emergence and last known child to the current time
   emergence = t;
   lastchild = t;
-}
-
-
-//Add a link to a descendent species in the phylogeny
-void PhyloNode::addChild(int n){
-  children.push_back(n);
+  //The node has no children or statistics yet
+  newest_child  = -1;
+  older_sibling = -1;
+  stats_record  = -1;
 }
 
 
@@ -36,21 +38,6 @@ bool PhyloNode::aliveAt(double t) const {
 }
 
 
-//Each time the phylogeny is updated, which happens every timestep, this is
-//called for each salamander that is still similar enough to its parent to be
-//part of the same species. The first time it is called, the lastchild is
-//updated; thereafter, the statistics of the species for this particular
-//timestep are updated.
-void PhyloNode::updateWithSal(const MtBin &mt, const Salamander &s, double t){
-  if(lastchild!=t || stats.size()==0){
-    lastchild = t;
-    stats.emplace_back(SpeciesStats(t));
-  }
-  stats.back().update(mt.heightkm(),s.otempdegC);
-}
-
-
-
 ///////////////////
 //Phylogeny Class
 ///////////////////
@@ -71,27 +58,148 @@ Phylogeny::Phylogeny(const Salamander &s, double t){
 //descendent species of the salamander's parent species
 int Phylogeny::addNode(const Salamander &s, double t){
   nodes.push_back(PhyloNode(s,t));
-  nodes[s.species].addChild(nodes.size()-1);
-  return nodes.size()-1; //Return the new node id
+  const int n = nodes.size()-1;
+  //Make the new node its parent's most recent child
+  nodes[n].older_sibling         = nodes[s.species].newest_child;
+  nodes[s.species].newest_child  = n;
+  return n; //Return the new node id
 }
 
 
+//Each time the phylogeny is updated, which happens every timestep, this is
+//called for each salamander that is still similar enough to its parent to be
+//part of the same species. The lastchild is updated and, the first time it is
+//called for this particular timestep, a new statistics record is begun; the
+//statistics are then updated. If statistics are not being recorded at this
+//timestep, only the lastchild is updated.
+void Phylogeny::updateWithSal(int n, const MtBin &mt, double otempdegC, double t, bool record_stats){
+  PhyloNode &node = nodes[n];
+  node.lastchild = t;
+  if(!record_stats)
+    return;
+  if(node.stats_record==-1 || stats.t[node.stats_record]!=t)
+    node.stats_record = stats.add(n,t);
+  stats.update(node.stats_record,mt.heightkm(),otempdegC);
+}
+
+
+//A run of salamanders in one bin which all match the same existing species.
+//See UpdatePhylogeny().
+struct MatchRange {
+  unsigned int bin;   //Bin the salamanders live in
+  unsigned int from;  //Start of the run within that bin's matched list
+  unsigned int to;    //End of the run, exclusive
+};
+
+
 //This method loops through all existent salamanders and updates the
 //phylogenetic tree to reflect which species have gone extinct, been born, or
 //survived.
-void Phylogeny::UpdatePhylogeny(double t, double dt, std::vector<MtBin> &mts){
-  for(auto &m: mts)     //Loop through parts of the mountain
-  for(auto &s: m.bin){  //Loop through the salamanders in this mountain bin
-    //If I have no parent, skip me
-    if(s.species==-1)
-      throw "Salamander with bad parent discovered!";
-
-    //I am similar to my parent, so mark my parent (species) as having survived
-    //this long
-    if(s.pSimilarGenome(nodes.at(s.species).genes, TheParams.speciesSimthresh())) {
-      nodes.at(s.species).updateWithSal(m,s,t);
-      continue;
+//
+//Neither a salamander's genome nor that of its species' node ever changes, so
+//once a salamander has been found to be similar to its species it always will
+//be. Such salamanders are marked as settled and only need their species'
+//statistics updated. The genome comparisons are therefore only made for
+//salamanders born since the last update, and the results are the same as if
+//every salamander were checked every time.
+//
+//The update runs in four phases so that most of the work can be split between
+//threads while giving exactly the results of visiting every salamander in bin
+//order on one thread:
+//  1. (Parallel over bins) Each salamander is classified as matching its
+//     species or as having diverged from it. The matching salamanders are
+//     grouped by species.
+//  2. (Serial) The groups are gathered by species, and the position of the
+//     first salamander to match each species is noted.
+//  3. (Serial) The diverged salamanders are assigned to sibling species or to
+//     new species in bin order, so new species get the same ids they would
+//     have on one thread.
+//  4. (Parallel over species) Each species' statistics are accumulated from
+//     its matching salamanders in bin order, so even the floating-point sums
+//     come out the same.
+void Phylogeny::UpdatePhylogeny(double t, double dt, int species_sim_thresh, std::vector<MtBin> &mts, int threads, bool record_stats){
+  const unsigned int nbins = mts.size();
+
+  //Phase 1. matched[b] holds (species<<32)|index for each salamander in bin b
+  //which matches its species, sorted so that each species' salamanders are
+  //together and in order. diverged[b] holds the indices of the rest.
+  std::vector< std::vector<std::uint64_t> > matched(nbins);
+  std::vector< std::vector<unsigned int>  > diverged(nbins);
+  std::exception_ptr bin_exception;
+  #pragma omp parallel for num_threads(threads) if(threads>1) schedule(dynamic)
+  for(unsigned int b=0;b<nbins;b++){
+    try {
+      Population &pop = mts[b].bin;
+      for(unsigned int i=0;i<pop.size();i++){
+        //If I have no parent, skip me
+        if(pop.species[i]==-1)
+          throw "Salamander with bad parent discovered!";
+
+        //I am similar to my parent, so my parent (species) has survived this
+        //long. Salamanders which have already been shown to be similar need
+        //not be checked again.
+        if(pop.settled[i] || Salamander::pSimilarGenome(pop.genes[i], nodes.at(pop.species[i]).genes, species_sim_thresh)){
+          pop.settled[i] = 1;
+          matched[b].push_back(((std::uint64_t)pop.species[i]<<32) | i);
+        } else {
+          diverged[b].push_back(i);
+        }
+      }
+      std::sort(matched[b].begin(), matched[b].end());
+    } catch (...) {
+      #pragma omp critical(phylo_exception)
+      if(!bin_exception)
+        bin_exception = std::current_exception();
     }
+  }
+  if(bin_exception)
+    std::rethrow_exception(bin_exception);
+
+  //Phase 2. Gather the runs of matching salamanders by species. The runs of
+  //species sp are ranges[range_start[sp],range_start[sp+1]), in bin order.
+  //first_match[sp] is the position, (bin<<32)|index, of the first salamander
+  //to match species sp, which is when the one-thread update would have marked
+  //the species as alive.
+  const std::uint64_t NEVER     = std::numeric_limits<std::uint64_t>::max();
+  const unsigned int  old_nodes = nodes.size();
+  std::vector<unsigned int>  range_start(old_nodes+1, 0);
+  std::vector<std::uint64_t> first_match(old_nodes, NEVER);
+  for(unsigned int b=0;b<nbins;b++)
+  for(unsigned int k=0;k<matched[b].size();k++){
+    const unsigned int sp = matched[b][k]>>32;
+    if(k>0 && (matched[b][k-1]>>32)==sp)
+      continue;
+    range_start[sp+1]++;
+    if(first_match[sp]==NEVER)
+      first_match[sp] = ((std::uint64_t)b<<32) | (matched[b][k] & 0xFFFFFFFF);
+  }
+  for(unsigned int sp=0;sp<old_nodes;sp++)
+    range_start[sp+1] += range_start[sp];
+
+  std::vector<MatchRange>   ranges(range_start[old_nodes]);
+  std::vector<unsigned int> next_range(range_start.begin(), range_start.end()-1);
+  for(unsigned int b=0;b<nbins;b++)
+  for(unsigned int k=0;k<matched[b].size();){
+    const unsigned int sp  = matched[b][k]>>32;
+    unsigned int       end = k+1;
+    while(end<matched[b].size() && (matched[b][end]>>32)==sp)
+      end++;
+    ranges[next_range[sp]++] = MatchRange{b, k, end};
+    k = end;
+  }
+
+  //Phase 3. Find species for the salamanders which no longer match their own
+  for(unsigned int b=0;b<nbins;b++)
+  for(const auto i: diverged[b]){
+    MtBin &m = mts[b];
+
+    //Aliases for the properties of this salamander. Only the species and the
+    //settled flag are ever modified.
+    int                        &species   = m.bin.species[i];
+    unsigned char              &settled   = m.bin.settled[i];
+    const Salamander::genetype &genes     = m.bin.genes[i];
+    const double                otempdegC = m.bin.otempdegC[i];
+    const std::uint64_t         position  = ((std::uint64_t)b<<32) | i;
 
     //If I am not similar to my parent then I may still be similar to one of my
     //parent's other children, which may already have an entry in the phylogeny.
@@ -99,27 +207,29 @@ void Phylogeny::UpdatePhylogeny(double t, double dt, std::vector<MtBin> &mts){
     //this was the case.
     bool has_parent=false;
 
-    //See if I am similar to any other salamanders, starting with the most
-    //recent. If I reach my parent, then I know I can't be related to any
-    //species that was added to the phylogeny before my parent except by random
-    //chance; therefore, I stop my search at that point.
-    for(int p=nodes.size()-1;p>=s.species;--p) {
+    //See if I am similar to any of my parent's other children, starting with
+    //the most recent. Only these can share my parent species, and a node's
+    //children are listed from the most recently added to the oldest, so walking
+    //the list visits the same candidates in the same order as walking the whole
+    //phylogeny backwards down to my parent would.
+    for(int p=nodes.at(species).newest_child;p!=-1;p=nodes[p].older_sibling) {
+
       //If the last child of this potential parent was born more than 1.5 time
       //step ago, then this parent's lineage is dead and I cannot be a part of
       //it. This works because we are stepping by dt-Myr, so 2*dt-Myr is two
       //time steps. We use 1.5 timesteps to avoid issues with floating-point
-      //math.
-      if( (t-nodes.at(p).lastchild)>=1.5*dt ) continue;
-
-      //If my parent species is the same as this species's parent species and my
-      //genes are similar to this salamander's then this salamander and I are
-      //both part of the first generation of a new species of salamander.
-      //Therefore, I will my parent species to be this species, since its genome
-      //is already stored in the phylogeny
-      if( s.species==nodes.at(p).parent && 
-          s.pSimilarGenome(nodes.at(p).genes, TheParams.speciesSimthresh())
-      ){
-        s.species  = p;
+      //math. The species' statistics for this step are not recorded until
+      //phase 4, so a species which a salamander before me matched counts as
+      //alive too.
+      const bool matched_before_me = (unsigned int)p<old_nodes && first_match[p]<position;
+      if( (t-nodes[p].lastchild)>=1.5*dt && !matched_before_me ) continue;
+
+      //If my genes are similar to this sibling species' then this salamander
+      //and I are both part of the first generation of a new species of
+      //salamander. Therefore, I will my parent species to be this species,
+      //since its genome is already stored in the phylogeny
+      if(Salamander::pSimilarGenome(genes, nodes[p].genes, species_sim_thresh)){
+        species    = p;
         has_parent = true;
         break;
       }
@@ -128,10 +238,42 @@ void Phylogeny::UpdatePhylogeny(double t, double dt, std::vector<MtBin> &mts){
     //No salamander in the phylogeny was similar to me! Therefore, I add myself
     //to the phylogeny as a new species and set my species id accordingly
     if(!has_parent){
-      s.species = addNode(s,t);
+      species = addNode(m.bin.get(i),t);
 
       //Make sure we have stats for the first timestep of the species' existence
-      nodes.at(s.species).updateWithSal(m,s,t);
+      updateWithSal(species,m,otempdegC,t,record_stats);
+    }
+
+    //I now belong to a species whose genome I match. This is only untrue if
+    //the similarity threshold is too strict for any genome to pass, in which
+    //case I must be checked again next time.
+    settled = Salamander::pSimilarGenome(genes, nodes[species].genes, species_sim_thresh);
+  }
+
+  //Phase 4. Mark each species matched in phase 1 as having survived this long
+  //and record its statistics. Any records missing for this step are added to
+  //the store here, so that each thread only writes to the records of its own
+  //species below. A species joined by a diverged salamander in phase 3 already
+  //has one.
+  for(unsigned int sp=0;sp<old_nodes;sp++){
+    if(range_start[sp]==range_start[sp+1])
+      continue;
+    PhyloNode &node = nodes[sp];
+    node.lastchild = t;
+    if(record_stats && (node.stats_record==-1 || stats.t[node.stats_record]!=t))
+      node.stats_record = stats.add(sp,t);
+  }
+  if(!record_stats)
+    return;
+
+  #pragma omp parallel for num_threads(threads) if(threads>1) schedule(dynamic,64)
+  for(unsigned int sp=0;sp<old_nodes;sp++)
+  for(unsigned int r=range_start[sp];r<range_start[sp+1];r++){
+    const MatchRange &range = ranges[r];
+    const MtBin      &m     = mts[range.bin];
+    for(unsigned int k=range.from;k<range.to;k++){
+      const unsigned int i = matched[range.bin][k] & 0xFFFFFFFF;
+      stats.update(nodes[sp].stats_record,m.heightkm(),m.bin.otempdegC[i]);
     }
   }
 }
@@ -152,51 +294,59 @@ int Phylogeny::livingSpecies(double t) const {
 }
 
 
+//Count the living species in the subtree rooted at each node. A node's parent
+//always has a smaller id than the node itself, so visiting the nodes from the
+//newest to the oldest visits every node before its parent.
+std::vector<unsigned int> Phylogeny::livingDescendants(double t) const {
+  std::vector<unsigned int> count(nodes.size(),0);
+  for(int n=(int)nodes.size()-1;n>=0;--n){
+    count[n] += nodes[n].aliveAt(t);
+    //Eve is her own parent
+    if(n!=nodes[n].parent)
+      count[nodes[n].parent] += count[n];
+  }
+  return count;
+}
+
+
+//The last common ancestor of two species A and B is the deepest node whose
+//subtree contains both. Rather than finding it separately for each pair, we
+//compute for every node X the sum over all living species B of the emergence
+//time of LCA(X,B), which we call H[X]. At the root, every LCA is the root, so
+//H[Eve] = emergence(Eve)*count(Eve). Moving from a node V down to its child C
+//changes the LCA only for the species below C, which goes from V to C, so
+//H[C] = H[V] + (emergence(C)-emergence(V))*count(C). For a living species A the
+//sum of its branch distances to the other species is then
+//(S-1)*t - (H[A]-emergence(A)), since LCA(A,A) is A itself. This takes O(N)
+//time for N nodes rather than O(S^2) ancestor walks for S living species.
 Phylogeny::mbdStruct Phylogeny::meanBranchDistance(double t) const {
   //Mean branch distance structure containing (avg branch dist, species) pairs
   mbdStruct mbd;
 
-  //We start by finding those species which are alive at the given time
-  std::vector<int> alive;
-  for(unsigned int i=0;i<nodes.size();++i)
-    if(nodes[i].aliveAt(t))
-      alive.push_back(i);
-
-  //Enlarge to match size of alive. Initialise everything to 0.
-  mbd.resize(alive.size(),std::pair<double,int>(0,0));
-
-  //For each species that is alive
-  for(unsigned int a=0;a<alive.size();++a){
-    //Set the appropriate species ID
-    mbd[a].second=alive[a];
-
-    //Walk up the tree finding ancestors of A until we get to Eve. Eve is not
-    //added to the list of ancestors, but that's okay, as we'll explain below.
-    std::set<int> parentsOfA;
-    int p=alive[a];
-    do {
-      parentsOfA.insert(p);
-      p=nodes[p].parent;
-    } while( p != nodes[p].parent);
-
-    //For each other node B, find its Lowest Common Ancestor with A
-    for(unsigned int b=a+1;b<alive.size();++b){
-      int p=alive[b];
-      //Walk up the list until we get to Eve. If we find a common ancestor
-      //before Eve, then break early. Otherwise, Eve is the last ancestor we
-      //would check and must be a common ancestor, therefore if we don't break
-      //we terminate pointing at Eve, who is the LCA.
-      do {
-        if(parentsOfA.count(p)) break;
-        p = nodes[p].parent;
-      } while(p!=nodes[p].parent);
-      mbd[a].first += t-nodes[p].emergence;
-      mbd[b].first += t-nodes[p].emergence;
-    }
+  const std::vector<unsigned int> count = livingDescendants(t);
+
+  //Parents are visited before their children, as above
+  std::vector<double> lca_sum(nodes.size(),0);
+  for(unsigned int n=0;n<nodes.size();++n){
+    const int p = nodes[n].parent;
+    if((int)n==p)
+      lca_sum[n] = nodes[n].emergence*count[n];
+    else
+      lca_sum[n] = lca_sum[p] + (nodes[n].emergence-nodes[p].emergence)*count[n];
   }
 
-  for(auto &i: mbd)
-    i.first/=alive.size()-1;
+  //Number of species alive at the given time
+  const unsigned int alive = nodes.empty() ? 0 : count[0];
+
+  //For each species that is alive, in order of species id
+  mbd.reserve(alive);
+  for(unsigned int i=0;i<nodes.size();++i){
+    if(!nodes[i].aliveAt(t))
+      continue;
+    const double others = alive-1.0;
+    const double total  = others*t - (lca_sum[i]-nodes[i].emergence);
+    mbd.push_back(std::pair<double,int>(total/others, i));
+  }
 
   return mbd;
 }
@@ -296,89 +446,184 @@ void Phylogeny::persistGraph(int run_num, std::ofstream &out) const {
 }
 
 
-//Print the phylogeny as a Newick tree
-std::string Phylogeny::printNewick(int n, int depth) const {
-  if(nodes[n].children.empty()){
-    double length=nodes[n].lastchild-nodes[n].emergence;
-    return "S"+std::to_string(n) + ":" + std::to_string(length);
+//Collects output in a fixed-size buffer and hands it to the stream in large
+//blocks, so that writing a tree costs a few calls to the stream rather than one
+//per token
+class NewickSink {
+ public:
+  NewickSink(std::ostream &out) : out(out), used(0) {}
+  ~NewickSink(){ flush(); }
+
+  void put(char c){
+    if(used==sizeof(buf)) flush();
+    buf[used++] = c;
   }
 
-  //Copy this node's list of children so that we can guarantee that this method
-  //does not alter the phylogeny data
-  std::vector<int> my_children(nodes[n].children.begin(), nodes[n].children.end());
-
-  //Reverse the order of the children so that the list of children is order from
-  //most to least recent
-  std::reverse(my_children.begin(),my_children.end());
-
-  //This string holds the phylogeny of the node as we build it. Since the node
-  //may have several children which emerged at different times we assume that
-  //the parent also becomes a new species at that time and inject "virtual
-  //nodes" into the output of the phylogeny. This string holds the virtual nodes
-  //as we build them.
-  std::string my_phylo="";
-
-  for(unsigned int c=0;c<my_children.size();c++){
-    //Alias for the current child
-    int child=my_children[c];
-
-    //Avoid an infinite loop with Eve
-    if(n==child) continue;
-
-    //Holds the returned Newick representation of the phylogeny rooted at the
-    //current child
-    std::string childphylo=printNewick(child,depth+1);
-
-    //If this is the most recent child the parent has had, then the parent's
-    //lineage ends when the parent has its last child. Thus, the phylogeny is of
-    //the form: (ParentName:TimeToParentsLastChild,ChildName:TimeToChildsLastChild)
-    if(c==0){
-      my_phylo="(S";
-      my_phylo+=std::to_string(n)+":";
-      my_phylo+=std::to_string(nodes[n].lastchild-nodes[child].emergence);
-      my_phylo+=",";
-      my_phylo+=childphylo;
-      my_phylo+=")";
-    } else {
-    //This isn't the most recent child the parent has had. The current child has
-    //a phylogeny and the more recent child has a phylogeny as well. Thus, we
-    //need to weld these two phylogenies together
-      std::string temp="(";
-      temp+=my_phylo+":";
-      //The previous child returned a phylogeny including a virtual node. This
-      //virtual node indicates a branching that took place when the previous
-      //child split from the parent line. This branching took place at the point
-      //in time at which the previous child emerged. So the length to that node
-      //is from the emergence time of this child (the time of this splitting) to
-      //the emergence time of the previous child. Note: If the previous child
-      //split at the same time this child did, then there is a trifurcation. We
-      //do not explicitly handle this case.
-      int prevchild=my_children[c-1];
-      temp+=std::to_string(nodes[prevchild].emergence-nodes[child].emergence);
-      temp+=",";
-      temp+=childphylo;
-      //Since "childphylo" is a valid phylogeny and includes a distance to
-      //root, it is not necessary to specify a distance here
-      temp+=")";
-      my_phylo=temp;
-    }
+  void put(const char *str){
+    while(*str) put(*str++);
+  }
+
+  //Species labels, such as S123
+  void putSpecies(int n){
+    reserve(16);
+    used += std::snprintf(buf+used, sizeof(buf)-used, "S%d", n);
+  }
+
+  //Branch lengths, formatted as std::to_string() formats doubles
+  void putLength(double x){
+    reserve(400); //Enough for any double written with %f
+    used += std::snprintf(buf+used, sizeof(buf)-used, "%f", x);
+  }
+
+  void flush(){
+    out.write(buf, used);
+    used = 0;
+  }
+
+ private:
+  std::ostream &out;
+  char          buf[1<<16];
+  std::size_t   used;
+
+  void reserve(std::size_t n){
+    if(sizeof(buf)-used<n) flush();
+  }
+};
+
+
+//Write the phylogeny as a Newick tree
+//
+//Each species' lineage runs from its emergence to its last child. Since a node
+//may have several children which emerged at different times we assume that the
+//parent also becomes a new species at each of those times and inject "virtual
+//nodes" into the output. Working from the most recent child to the oldest, the
+//parent's own tip is joined with the most recent child, the result is joined
+//with the next most recent child, and so on. A join at time T of a group G and
+//a child subtree P is written as
+//
+//    (G:(time of G's top node - T),P:(time of P's top node - T))
+//
+//where a tip's top node is its last child and a join's top node is the time at
+//which it took place. If the trifurcation case arises, where two children split
+//at the same time, we do not explicitly handle it.
+//
+//When only extant species are wanted, subtrees without living species are left
+//out, as are the tips of dead species. A dead species with a single surviving
+//child subtree therefore contributes no join, and the branch above the child
+//subtree is lengthened accordingly.
+//
+//The tree is walked with an explicit stack rather than by recursion, so deep
+//trees cannot overflow the call stack.
+//
+//Eve is her own child, so the original recursive writer never wrote her tip
+//unless she had other children: a tree of Eve alone is written without a
+//label, as ":0.000000;". That output is kept.
+void Phylogeny::writeNewick(std::ostream &out, double t, bool extant_only) const {
+  //A simulation which failed before Eve was placed has an empty tree
+  if(nodes.empty()){
+    out<<';';
+    return;
+  }
+
+  NewickSink sink(out);
+
+  const std::vector<unsigned int> living = extant_only ? livingDescendants(t) : std::vector<unsigned int>();
+
+  //Whether child c of node n is written, and whether n's tip is written. Eve is
+  //her own child, but is never written as such.
+  auto keep_child = [&](int n, int c){ return c!=n && (!extant_only || living[c]>0); };
+  auto keep_tip   = [&](int n){ return !extant_only || nodes[n].aliveAt(t); };
+
+  bool lone_root = true;
+  for(int c=nodes[0].newest_child;c!=-1;c=nodes[c].older_sibling)
+    lone_root &= !keep_child(0,c);
+  if(lone_root){
+    sink.put(':');
+    sink.putLength(0);
+    sink.put(';');
+    return;
   }
 
-  //This is the distance between the least recent child's emergence and the
-  //emergence of the parent. Having this here ensures that every time this
-  //function returns the result is a valid phylogeny including a distance to
-  //root
-  my_phylo+=":";
-  my_phylo+=std::to_string(nodes[my_children.back()].emergence-nodes[n].emergence);
+  //The state of a node whose subtree is being written
+  struct Frame {
+    int    node;      //Node being written
+    int    cursor;    //Next child to consider, or -1; children are visited newest first
+    double top_time;  //Time of the top node of what has been written so far
+    bool   started;   //True once the first item (tip or child) is written
+    int    child;     //Child currently being written, or -1
+    bool   joining;   //True if the child is being joined to earlier items
+  };
+  std::vector<Frame> stack;
+
+  //Begin writing node n. The number of joins is one less than the number of
+  //items, and each join needs an opening parenthesis up front.
+  auto enter = [&](int n){
+    int items = keep_tip(n);
+    for(int c=nodes[n].newest_child;c!=-1;c=nodes[c].older_sibling)
+      items += keep_child(n,c);
+    for(int i=1;i<items;i++)
+      sink.put('(');
+
+    Frame f = {n, nodes[n].newest_child, nodes[n].emergence, false, -1, false};
+    if(keep_tip(n)){
+      sink.putSpecies(n);
+      f.top_time = nodes[n].lastchild;
+      f.started  = true;
+    }
+    stack.push_back(f);
+  };
+
+  enter(0);
+  while(true){
+    Frame &f = stack.back();
+
+    //Skip children which are not written
+    while(f.cursor!=-1 && !keep_child(f.node, f.cursor))
+      f.cursor = nodes[f.cursor].older_sibling;
+
+    if(f.cursor!=-1){
+      //Write the next child, joining it to what has been written so far
+      const int c = f.cursor;
+      f.cursor    = nodes[c].older_sibling;
+      f.child   = c;
+      f.joining = f.started;
+      if(f.joining){
+        sink.put(':');
+        sink.putLength(f.top_time-nodes[c].emergence);
+        sink.put(',');
+      }
+      f.started = true;
+      enter(c); //Invalidates f
+      continue;
+    }
 
-  //All done: let's wrap things up nicely
-  if(depth==0)
-    my_phylo+=";";
+    //This subtree is complete. Hand its top node's time to the parent.
+    const double top_time = f.top_time;
+    stack.pop_back();
+    if(stack.empty())
+      break;
+
+    Frame &parent = stack.back();
+    const double split = nodes[parent.child].emergence;
+    if(parent.joining){
+      sink.put(':');
+      sink.putLength(top_time-split);
+      sink.put(')');
+      parent.top_time = split;
+    } else {
+      parent.top_time = top_time;
+    }
+    parent.child = -1;
+  }
 
-  return my_phylo;
+  //The root's branch has no length
+  sink.put(':');
+  sink.putLength(0);
+  sink.put(';');
 }
 
 
+
 //For each node in the phylogenetic tree, print the summary statistics of that
 //species throughout the duration of its existence
 void Phylogeny::speciesSummaries(int run_num, std::ofstream &out) const {
@@ -386,19 +631,58 @@ void Phylogeny::speciesSummaries(int run_num, std::ofstream &out) const {
     out<<"RunNum, Species, Time, NumAlive, ElevMin, "
        <<"ElevMax, ElevAvg, TempMin, TempMax, TempAvg\n";
   //For each node, there is a stats record of each time the species was alive
-  for(unsigned int i=0;i<nodes.size();++i)
-  for(auto &ss: nodes[i].stats){  
-    if(ss.t>64.9) {
-     out<<run_num                        <<","
-        <<i                              <<","
-        <<ss.t                           <<","
-        <<ss.num_alive                   <<","
-        <<ss.elev_min                    <<","
-        <<ss.elev_max                    <<","
-        <<(ss.elev_avg/ss.num_alive)     <<","
-        <<ss.opt_temp_min                <<","
-        <<ss.opt_temp_max                <<","
-        <<(ss.opt_temp_avg/ss.num_alive) << std::endl;
-    }
+  //and statistics were being recorded. See Params::statsRecording(). The
+  //records are stored in the order they were made, so they are first put in
+  //order of species.
+  for(const auto r: stats.bySpecies(nodes.size())){
+     out<<run_num                                  <<","
+        <<stats.node[r]                            <<","
+        <<stats.t[r]                               <<","
+        <<stats.num_alive[r]                       <<","
+        <<stats.elev_min[r]                        <<","
+        <<stats.elev_max[r]                        <<","
+        <<(stats.elev_sum[r]/stats.num_alive[r])   <<","
+        <<stats.opt_temp_min[r]                    <<","
+        <<stats.opt_temp_max[r]                    <<","
+        <<(stats.opt_temp_sum[r]/stats.num_alive[r]) << std::endl;
   }
-}
\ No newline at end of file
+}
+
+
+//Each node is written field by field, so that the checkpoint does not depend on
+//how the compiler pads PhyloNode
+void Phylogeny::save(std::ostream &out) const {
+  WriteBinary(out, (std::uint64_t)nodes.size());
+  for(const auto &n: nodes){
+    WriteBinary(out, n.genes);
+    WriteBinary(out, n.emergence);
+    WriteBinary(out, n.lastchild);
+    WriteBinary(out, n.parent);
+    WriteBinary(out, n.otempdegC);
+    WriteBinary(out, n.newest_child);
+    WriteBinary(out, n.older_sibling);
+    WriteBinary(out, n.stats_record);
+  }
+  stats.save(out);
+}
+
+
+void Phylogeny::load(std::istream &in){
+  std::uint64_t nnodes;
+  ReadBinary(in, nnodes);
+  nodes.clear();
+  nodes.reserve(nnodes);
+  for(std::uint64_t i=0;i<nnodes;i++){
+    nodes.push_back(PhyloNode(Salamander(), 0));
+    PhyloNode &n = nodes.back();
+    ReadBinary(in, n.genes);
+    ReadBinary(in, n.emergence);
+    ReadBinary(in, n.lastchild);
+    ReadBinary(in, n.parent);
+    ReadBinary(in, n.otempdegC);
+    ReadBinary(in, n.newest_child);
+    ReadBinary(in, n.older_sibling);
+    ReadBinary(in, n.stats_record);
+  }
+  stats.load(in);
+}
@@ -3,49 +3,14 @@
 
 #include "salamander.hpp"
 #include "mtbin.hpp"
+#include "species_stats.hpp"
 #include <vector>
 #include <string>
 #include <fstream>
+#include <ostream>
 #include <limits>
 #include <algorithm>
 
-//SpeciesStats is used to hold summary statistics above the distribution of
-//salamander properties at each time step of a species' existence
-class SpeciesStats {
- public:
-  double t;             //Time at which these statistics were collected
-  int num_alive;        //Number of species alive at that time
-  double elev_min;      //Minimum elevation of the species at that time
-  double elev_max;      //Maximum elevation of the species at that time
-  double elev_avg;      //Average elevation of the species at that time
-  double opt_temp_min;  //Minimum of the optimum temperature trait at that time
-  double opt_temp_max;  //Maximum of the optimum temperature trait at that time
-  double opt_temp_avg;  //Average of the optimum temperature trait at that time
-  SpeciesStats(double t0){
-    //In the following we set everything up so it is ready for a "reduction"
-    //pattern
-    t            = t0;
-    num_alive    = 0;
-    elev_min     = std::numeric_limits<double>::max();
-    elev_max     = std::numeric_limits<double>::min();
-    elev_avg     = 0;
-    opt_temp_min = std::numeric_limits<double>::max();
-    opt_temp_max = std::numeric_limits<double>::min();
-    opt_temp_avg = 0;
-  }
-
-  void update(double elevation, double opt_temp) {
-    num_alive++;
-    elev_min     = std::min(elev_min,elevation);
-    elev_max     = std::max(elev_max,elevation);
-    elev_avg    += elevation;
-    opt_temp_min = std::min(opt_temp_min,opt_temp);
-    opt_temp_max = std::max(opt_temp_max,opt_temp);
-    opt_temp_avg += opt_temp;
-  }
-};
-
-
 ///PhyloNode is used to store information about distinct species, the time that
 ///the node came into being, the time that it went extinct, the genetic
 ///attributes of the parent species from which the node arose, and any child
@@ -77,23 +42,22 @@ class PhyloNode {
   ///Copied from Salamander on initialisation.
   double otempdegC;
 
-  ///Children of this node. Lists all species that have branched off of this
-  ///species.
-  std::vector<int> children;
-
-  std::vector<SpeciesStats> stats;
+  ///Children of this node, which are all the species that have branched off
+  ///of this species, form a linked list running from the most recent child to
+  ///the oldest. newest_child is the head of this node's list and
+  ///older_sibling is the next entry of the list this node belongs to. Both are
+  ///indices into the Phylogeny class's list of PhyloNodes, or -1 for none.
+  ///Storing the lists in the nodes avoids a separate allocation per node.
+  int newest_child;
+  int older_sibling;
 
-  ///Adds a child to this node. Child is represented by an integer, which
-  ///corresponds to the child's placement in the Phylogeny class's list of
-  ///Phylonodes.
-  void addChild(int n);
+  ///Index in the Phylogeny's statistics store of this species' most recent
+  ///record, or -1 if it has none.
+  int stats_record;
 
   ///Returns true if the strain is alive at the indicated time, based on the
   ///emergence and lastchild data.
   bool aliveAt(double t) const;
-
-  ///Sets the lastchild time and updates the species' statistics
-  void updateWithSal(const MtBin &mt, const Salamander &s, double t);
 };
 
 
@@ -106,6 +70,11 @@ class Phylogeny {
   ///Adds a new node to the phylogeny
   int addNode(const Salamander &s, double t);
 
+  ///Sets the lastchild time of species n and, if record_stats is true, updates
+  ///the species' statistics with a salamander of optimal temperature otempdegC
+  ///living in bin mt
+  void updateWithSal(int n, const MtBin &mt, double otempdegC, double t, bool record_stats);
+
   ///Calculate the mean branch distance for the phylogeny. Finds the
   //distance between each species and the last common ancestor of that species
   //and all other species in the phylogeny. (e.g., if 2MY
@@ -118,6 +87,10 @@ class Phylogeny {
   typedef std::vector< std::pair<double, int> > mbdStruct;
   mbdStruct meanBranchDistance(double t) const;
 
+  ///Returns, for each node, the number of species alive at time t in the
+  ///subtree rooted at that node (including the node itself)
+  std::vector<unsigned int> livingDescendants(double t) const;
+
  public:
   ///Empty constructor -- creates a phylogeny without any attributes.
   ///Avoid using this whenever possible!!
@@ -129,8 +102,15 @@ class Phylogeny {
   ///The collection of phylogenetic nodes compromising the tree
   std::vector<PhyloNode> nodes;
 
-  ///Updates the phylogeny based on the current state of the salamanders
-  void UpdatePhylogeny(double t, double dt, std::vector<MtBin> &mts);
+  ///Statistics of every species at each time step they were recorded
+  SpeciesStatsStore stats;
+
+  ///Updates the phylogeny based on the current state of the salamanders.
+  ///Salamanders are of the same species if their genomes are similar to within
+  ///species_sim_thresh. The work is split between the given number of threads;
+  ///the result does not depend on how many are used. Species' statistics are
+  ///only recorded if record_stats is true.
+  void UpdatePhylogeny(double t, double dt, int species_sim_thresh, std::vector<MtBin> &mts, int threads=1, bool record_stats=true);
 
   ///Counts the number of species which are alive at a given point in time
   int livingSpecies(double t) const;
@@ -146,12 +126,19 @@ class Phylogeny {
   ///Print species labels and their persistence to the specified output stream
   void persistGraph(int run_num, std::ofstream &out) const;
 
-  ///Returns a Newick representation of the tree's living members at a given
-  ///time. See: https://en.wikipedia.org/wiki/Newick_format
-  std::string printNewick(int n=0, int depth=0) const;
+  ///Writes a Newick representation of the tree to the given stream. If
+  ///extant_only is true, only the species alive at time t and their ancestry
+  ///are written. See: https://en.wikipedia.org/wiki/Newick_format
+  void writeNewick(std::ostream &out, double t, bool extant_only) const;
 
-  ///Prints each species' SpeciesStats vector to the specified file
+  ///Prints each species' statistics to the specified file
   void speciesSummaries(int run_num, std::ofstream &out) const;
+
+  ///Writes the nodes and statistics to a checkpoint. See checkpoint.hpp.
+  void save(std::ostream &out) const;
+
+  ///Replaces the phylogeny with one written by save()
+  void load(std::istream &in);
 };
 
 #endif
\ No newline at end of file
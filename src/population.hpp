@@ -0,0 +1,177 @@
+//The salamanders of a bin are stored as a structure of arrays: each property of
+//the salamanders lives in its own contiguous array. The hot loops of the
+//simulation (mortality, breeding, dispersal, phylogeny updates) each touch only
+//one or two of these properties, so splitting them up reduces the number of
+//bytes that must be pulled through the cache on each pass.
+#ifndef _population_hpp_
+#define _population_hpp_
+
+#include "salamander.hpp"
+#include "checkpoint.hpp"
+#include <vector>
+#include <cassert>
+#include <cstddef>
+
+class Population {
+ public:
+  ///Neutral genes of each salamander. See Salamander::genes
+  std::vector<Salamander::genetype> genes;
+
+  ///Optimal temperature of each salamander. See Salamander::otempdegC
+  std::vector<double>               otempdegC;
+
+  ///Species of each salamander. See Salamander::species
+  std::vector<int>                  species;
+
+  ///Non-zero once the phylogeny has confirmed that the salamander's genome is
+  ///similar to that of its species. Neither genome ever changes, so the check
+  ///need not be repeated. Salamanders added with push_back() start unsettled.
+  ///See Phylogeny::UpdatePhylogeny()
+  std::vector<unsigned char>        settled;
+
+  ///Number of salamanders in the population
+  std::size_t size() const { return species.size(); }
+
+  ///True if there are no salamanders in the population
+  bool empty() const { return species.empty(); }
+
+  ///Reserve space for n salamanders in each of the arrays
+  void reserve(std::size_t n){
+    genes.reserve(n);
+    otempdegC.reserve(n);
+    species.reserve(n);
+    settled.reserve(n);
+  }
+
+  ///Remove all of the salamanders
+  void clear(){
+    genes.clear();
+    otempdegC.clear();
+    species.clear();
+    settled.clear();
+  }
+
+  ///Append a salamander to the end of the population
+  void push_back(const Salamander &s){
+    genes.push_back(s.genes);
+    otempdegC.push_back(s.otempdegC);
+    species.push_back(s.species);
+    settled.push_back(0);
+  }
+
+  ///Gather the properties of the i-th salamander into a Salamander object
+  Salamander get(std::size_t i) const {
+    Salamander s;
+    s.genes     = genes[i];
+    s.otempdegC = otempdegC[i];
+    s.species   = species[i];
+    return s;
+  }
+
+  ///Remove the i-th salamander by overwriting it with the last salamander and
+  ///then popping the back of the arrays. Loops which call this must consider
+  ///position i again, since it now holds a different salamander.
+  void swapRemove(std::size_t i){
+    assert(i<size());
+    genes[i]     = genes.back();
+    otempdegC[i] = otempdegC.back();
+    species[i]   = species.back();
+    settled[i]   = settled.back();
+    genes.pop_back();
+    otempdegC.pop_back();
+    species.pop_back();
+    settled.pop_back();
+  }
+
+  ///Remove every salamander i for which flagged[i] is non-zero. The survivors
+  ///keep their relative order. This is cheaper than calling swapRemove() many
+  ///times when a large fraction of the population is removed at once.
+  void removeFlagged(const std::vector<unsigned char> &flagged){
+    assert(flagged.size()>=size());
+    std::size_t keep = 0;
+    for(std::size_t i=0;i<size();i++){
+      if(flagged[i])
+        continue;
+      genes[keep]     = genes[i];
+      otempdegC[keep] = otempdegC[i];
+      species[keep]   = species[i];
+      settled[keep]   = settled[i];
+      keep++;
+    }
+    genes.resize(keep);
+    otempdegC.resize(keep);
+    species.resize(keep);
+    settled.resize(keep);
+  }
+
+  ///Remove the salamanders at the given indices, which must be in increasing
+  ///order. The survivors keep their relative order. Only the salamanders after
+  ///the first removed one are moved.
+  void removeSorted(const std::vector<unsigned int> &indices){
+    if(indices.empty())
+      return;
+    std::size_t keep = indices[0];
+    std::size_t next = 0;
+    for(std::size_t i=indices[0];i<size();i++){
+      if(next<indices.size() && indices[next]==i){
+        next++;
+        continue;
+      }
+      genes[keep]     = genes[i];
+      otempdegC[keep] = otempdegC[i];
+      species[keep]   = species[i];
+      settled[keep]   = settled[i];
+      keep++;
+    }
+    genes.resize(keep);
+    otempdegC.resize(keep);
+    species.resize(keep);
+    settled.resize(keep);
+  }
+
+  ///Append a copy of the i-th salamander of `src` to the end of the population
+  void pushFrom(const Population &src, std::size_t i){
+    genes.push_back(src.genes[i]);
+    otempdegC.push_back(src.otempdegC[i]);
+    species.push_back(src.species[i]);
+    settled.push_back(src.settled[i]);
+  }
+
+  ///Append copies of salamanders [from,to) of `src` to the end of the
+  ///population, one array at a time
+  void append(const Population &src, std::size_t from, std::size_t to){
+    assert(&src!=this);
+    genes.insert    (genes.end(),     src.genes.begin()+from,     src.genes.begin()+to    );
+    otempdegC.insert(otempdegC.end(), src.otempdegC.begin()+from, src.otempdegC.begin()+to);
+    species.insert  (species.end(),   src.species.begin()+from,   src.species.begin()+to  );
+    settled.insert  (settled.end(),   src.settled.begin()+from,   src.settled.begin()+to  );
+  }
+
+  ///Append the i-th salamander to `dest` and then remove it from this
+  ///population. As with swapRemove(), position i must be considered again.
+  void transferTo(std::size_t i, Population &dest){
+    assert(&dest!=this);
+    dest.pushFrom(*this, i);
+    swapRemove(i);
+  }
+
+  ///Write the population to a checkpoint. See checkpoint.hpp.
+  void save(std::ostream &out) const {
+    WriteBinary(out, genes);
+    WriteBinary(out, otempdegC);
+    WriteBinary(out, species);
+    WriteBinary(out, settled);
+  }
+
+  ///Replace the population with one written by save()
+  void load(std::istream &in){
+    ReadBinary(in, genes);
+    ReadBinary(in, otempdegC);
+    ReadBinary(in, species);
+    ReadBinary(in, settled);
+    if(genes.size()!=species.size() || otempdegC.size()!=species.size() || settled.size()!=species.size())
+      throw std::runtime_error("Checkpoint has a malformed population!");
+  }
+};
+
+#endif
@@ -0,0 +1,260 @@
+//This file defines random number engines which can be used in place of
+//std::mt19937, along with generic functions which turn any engine's output into
+//uniform and normal variates, one at a time or in bulk. Each engine satisfies
+//the standard's UniformRandomBitGenerator requirements and can be seeded from a
+//std::seed_seq, so they are interchangeable with the standard engines.
+//
+//  Xoshiro256pp - xoshiro256++ by Blackman and Vigna. 32 bytes of state.
+//  Pcg64        - PCG XSL-RR 128/64 by O'Neill. 32 bytes of state.
+//  Philox4x64   - Philox4x64-10 by Salmon et al. A counter-based engine: the
+//                 output is a keyed hash of a counter.
+#ifndef _prng_engines_hpp_
+#define _prng_engines_hpp_
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <limits>
+
+class Xoshiro256pp {
+ public:
+  typedef std::uint64_t result_type;
+  static constexpr result_type min() { return 0; }
+  static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+  ///Engine state. Must not be all zeros.
+  std::uint64_t s[4];
+
+  Xoshiro256pp(){
+    s[0] = 0x9E3779B97F4A7C15ull; s[1] = 0xBF58476D1CE4E5B9ull;
+    s[2] = 0x94D049BB133111EBull; s[3] = 0x2545F4914F6CDD1Dull;
+  }
+
+  template<class Sseq>
+  void seed(Sseq &q){
+    std::uint32_t w[8];
+    q.generate(w, w+8);
+    for(int i=0;i<4;i++)
+      s[i] = ((std::uint64_t)w[2*i]<<32) | w[2*i+1];
+    if(!(s[0]|s[1]|s[2]|s[3]))  //The all-zero state is a fixed point
+      s[0] = 1;
+  }
+
+  result_type operator()(){
+    const std::uint64_t result = rotl(s[0]+s[3], 23)+s[0];
+    const std::uint64_t t      = s[1]<<17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3]  = rotl(s[3], 45);
+    return result;
+  }
+
+ private:
+  static std::uint64_t rotl(std::uint64_t x, int k){
+    return (x<<k) | (x>>(64-k));
+  }
+};
+
+
+
+class Pcg64 {
+ public:
+  typedef std::uint64_t result_type;
+  static constexpr result_type min() { return 0; }
+  static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+  ///Engine state and stream increment. The increment must be odd.
+  unsigned __int128 state, inc;
+
+  Pcg64(){
+    state = 0x979C9A98D8462005ull;
+    inc   = 1;
+  }
+
+  template<class Sseq>
+  void seed(Sseq &q){
+    std::uint32_t w[8];
+    q.generate(w, w+8);
+    state = 0;
+    inc   = 0;
+    for(int i=0;i<4;i++){
+      state = (state<<32) | w[i];
+      inc   = (inc  <<32) | w[4+i];
+    }
+    inc |= 1;
+    //Advance once so that the first output depends on the increment as well
+    (*this)();
+  }
+
+  result_type operator()(){
+    const unsigned __int128 mult =
+      ((unsigned __int128)0x2360ED051FC65DA4ull<<64) | 0x4385DF649FCCF645ull;
+    state = state*mult+inc;
+    const std::uint64_t xsl = (std::uint64_t)(state>>64) ^ (std::uint64_t)state;
+    const int           rot = (int)(state>>122);
+    return (xsl>>rot) | (xsl<<((-rot)&63));
+  }
+};
+
+
+
+class Philox4x64 {
+ public:
+  typedef std::uint64_t result_type;
+  static constexpr result_type min() { return 0; }
+  static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+  ///The key, the counter, the block of output generated from the counter, and
+  ///how much of that block has been used
+  std::uint64_t key[2], counter[4], block[4];
+  int           used;
+
+  Philox4x64(){
+    key[0] = key[1] = 0;
+    counter[0] = counter[1] = counter[2] = counter[3] = 0;
+    used = 4;
+  }
+
+  ///The seed sequence provides the key and the upper half of the counter. The
+  ///lower half of the counter counts blocks from zero.
+  template<class Sseq>
+  void seed(Sseq &q){
+    std::uint32_t w[8];
+    q.generate(w, w+8);
+    key[0]     = ((std::uint64_t)w[0]<<32) | w[1];
+    key[1]     = ((std::uint64_t)w[2]<<32) | w[3];
+    counter[0] = 0;
+    counter[1] = 0;
+    counter[2] = ((std::uint64_t)w[4]<<32) | w[5];
+    counter[3] = ((std::uint64_t)w[6]<<32) | w[7];
+    used       = 4;
+  }
+
+  result_type operator()(){
+    if(used==4){
+      generateBlock();
+      used = 0;
+    }
+    return block[used++];
+  }
+
+ private:
+  static void mulhilo(std::uint64_t a, std::uint64_t b, std::uint64_t &hi, std::uint64_t &lo){
+    const unsigned __int128 p = (unsigned __int128)a*b;
+    hi = (std::uint64_t)(p>>64);
+    lo = (std::uint64_t)p;
+  }
+
+  void generateBlock(){
+    std::uint64_t x[4] = {counter[0], counter[1], counter[2], counter[3]};
+    std::uint64_t k[2] = {key[0], key[1]};
+    for(int round=0;round<10;round++){
+      std::uint64_t hi0, lo0, hi1, lo1;
+      mulhilo(0xD2E7470EE14C6C93ull, x[0], hi0, lo0);
+      mulhilo(0xCA5A826395121157ull, x[2], hi1, lo1);
+      x[0] = hi1^x[1]^k[0];
+      x[1] = lo1;
+      x[2] = hi0^x[3]^k[1];
+      x[3] = lo0;
+      k[0] += 0x9E3779B97F4A7C15ull;
+      k[1] += 0xBB67AE8584CAA73Bull;
+    }
+    std::memcpy(block, x, sizeof(block));
+    //Increment the 128-bit block counter
+    if(++counter[0]==0)
+      ++counter[1];
+  }
+};
+
+
+
+///Returns 64 random bits from any engine. Engines which produce 32 bits at a
+///time, such as std::mt19937, are called twice.
+template<class Engine>
+inline std::uint64_t RandomBits64(Engine &e){
+  if(Engine::max()-Engine::min()==std::numeric_limits<std::uint64_t>::max())
+    return e()-Engine::min();
+  const std::uint64_t hi = (std::uint64_t)(e()-Engine::min());
+  const std::uint64_t lo = (std::uint64_t)(e()-Engine::min());
+  return (hi<<32) | (lo & 0xFFFFFFFFull);
+}
+
+///Converts 64 random bits into a double on [0,1) with 52 bits of resolution by
+///writing the top bits into the mantissa of a number in [1,2). This uses only
+///integer operations, so loops of it vectorize.
+inline double BitsToUnitInterval(std::uint64_t x){
+  x = (x>>12) | 0x3FF0000000000000ull;
+  double d;
+  std::memcpy(&d,&x,sizeof(double));
+  return d-1.0;
+}
+
+///Returns a uniformly distributed double on [from,thru)
+template<class Engine>
+inline double UniformReal(Engine &e, double from, double thru){
+  return from+(thru-from)*BitsToUnitInterval(RandomBits64(e));
+}
+
+///Returns a uniformly distributed integer on [from,thru] using Lemire's
+///multiply-and-reject method, which avoids a division on almost every call
+template<class Engine>
+inline int UniformInt(Engine &e, int from, int thru){
+  const std::uint64_t range = (std::uint64_t)((std::int64_t)thru-from)+1;
+  unsigned __int128 m = (unsigned __int128)RandomBits64(e)*range;
+  std::uint64_t low = (std::uint64_t)m;
+  if(low<range){
+    const std::uint64_t threshold = (0-range)%range;
+    while(low<threshold){
+      m   = (unsigned __int128)RandomBits64(e)*range;
+      low = (std::uint64_t)m;
+    }
+  }
+  return (int)((std::int64_t)from+(std::int64_t)(m>>64));
+}
+
+///Fills out[0..n) with uniformly distributed doubles on [from,thru). The
+///engine is stepped serially, after which the conversion to doubles runs as a
+///SIMD loop.
+template<class Engine>
+void FillUniform(Engine &e, double *out, unsigned int n, double from, double thru){
+  for(unsigned int i=0;i<n;i++){
+    const std::uint64_t x = RandomBits64(e);
+    std::memcpy(&out[i],&x,sizeof(double));
+  }
+  const double width = thru-from;
+  #pragma omp simd
+  for(unsigned int i=0;i<n;i++){
+    std::uint64_t x;
+    std::memcpy(&x,&out[i],sizeof(double));
+    out[i] = from+width*BitsToUnitInterval(x);
+  }
+}
+
+///Fills out[0..n) with normally distributed doubles using the Box-Muller
+///transform on a buffer of uniforms. The first half of the buffer supplies
+///radii and the second half supplies angles, so the transform is a SIMD loop.
+template<class Engine>
+void FillNormal(Engine &e, double *out, unsigned int n, double mean, double stddev){
+  if(n==0) return;
+  const unsigned int half = n/2;
+  FillUniform(e, out, n, 0, 1);
+  double *a = out;
+  double *b = out+half;
+  #pragma omp simd
+  for(unsigned int i=0;i<half;i++){
+    const double r     = stddev*std::sqrt(-2*std::log(1-a[i]));
+    const double theta = 6.283185307179586*b[i];
+    a[i] = mean+r*std::cos(theta);
+    b[i] = mean+r*std::cos(theta-1.5707963267948966);
+  }
+  //An odd count leaves one uniform at the end, which needs a partner
+  if(n%2==1){
+    const double r = stddev*std::sqrt(-2*std::log(1-out[n-1]));
+    out[n-1] = mean+r*std::cos(6.283185307179586*UniformReal(e,0,1));
+  }
+}
+
+#endif
@@ -6,47 +6,152 @@
 #include <iostream>
 #include <functional>
 #include <limits>
+#include <sstream>
+#include <string>
+#include "checkpoint.hpp"
 
-our_random_engine& rand_engine(){
-  static our_random_engine e[PRNG_THREAD_MAX];
-  return e[omp_get_thread_num()];
+///Seed from which all of the streams are derived. Set by seed_rand().
+static unsigned long global_seed = 0;
+
+///Stream numbers at and above this are used for the threads' default streams,
+///which serve any draws made while no stream is bound. Simulations use stream
+///numbers below this.
+static const unsigned long DEFAULT_STREAM_BASE = 1ul<<62;
+
+///Stream bound to the calling thread by RandomStreamBinding, if any
+static thread_local RandomStream *bound_stream = nullptr;
+
+///Each thread's default stream
+static RandomStream& default_stream(){
+  static thread_local RandomStream s(DEFAULT_STREAM_BASE+omp_get_thread_num());
+  return s;
+}
+
+
+RandomStream::RandomStream(unsigned long stream){
+  seed(stream);
 }
 
 
 //Be sure to read: http://www.pcg-random.org/posts/cpp-seeding-surprises.html
-//and http://www.pcg-random.org/posts/cpps-random_device.html
-void seed_rand(unsigned long seed){
-  #pragma omp parallel      //All threads must come here
-  {
-    #pragma omp critical    //But only one at a time
-    if(seed==0){
-      std::uint_least32_t seed_data[std::mt19937::state_size];
-      std::random_device r;
-      std::generate_n(seed_data, std::mt19937::state_size, std::ref(r));
-      std::seed_seq q(std::begin(seed_data), std::end(seed_data));
-      rand_engine().seed(q);
-    } else
-      rand_engine().seed( seed*omp_get_thread_num() );
+//The global seed and the stream number are both mixed into the engine's entire
+//state via a seed sequence, so that nearby seeds and stream numbers produce
+//unrelated streams.
+void RandomStream::seed(unsigned long stream){
+  std::seed_seq q{
+    (std::uint32_t)(global_seed & 0xFFFFFFFF), (std::uint32_t)(global_seed>>32),
+    (std::uint32_t)(stream      & 0xFFFFFFFF), (std::uint32_t)(stream     >>32)
+  };
+  engine.seed(q);
+  normal.reset();
+}
+
+
+void RandomStream::seed(unsigned long stream, unsigned long substream){
+  std::seed_seq q{
+    (std::uint32_t)(global_seed & 0xFFFFFFFF), (std::uint32_t)(global_seed>>32),
+    (std::uint32_t)(stream      & 0xFFFFFFFF), (std::uint32_t)(stream     >>32),
+    (std::uint32_t)(substream   & 0xFFFFFFFF), (std::uint32_t)(substream  >>32)
+  };
+  engine.seed(q);
+  normal.reset();
+}
+
+
+//The engines are plain values and are written as they are. The normal
+//distribution's cached value is private, so it is written using the
+//distribution's own text format, which preserves it exactly.
+void RandomStream::save(std::ostream &out) const {
+  static_assert(std::is_trivially_copyable<our_random_engine>::value, "The engine cannot be checkpointed");
+  WriteBinary(out, std::string(PRNG_ENGINE_NAME));
+  WriteBinary(out, engine);
+  std::ostringstream normal_state;
+  normal_state<<normal;
+  WriteBinary(out, normal_state.str());
+}
+
+
+void RandomStream::load(std::istream &in){
+  std::string engine_name;
+  ReadBinary(in, engine_name);
+  if(engine_name!=PRNG_ENGINE_NAME)
+    throw std::runtime_error("Checkpoint was made with a different random number engine!");
+  ReadBinary(in, engine);
+  std::string normal_state;
+  ReadBinary(in, normal_state);
+  std::istringstream ss(normal_state);
+  ss>>normal;
+  if(!ss)
+    throw std::runtime_error("Checkpoint has a bad normal distribution state!");
+}
+
+
+RandomStreamBinding::RandomStreamBinding(RandomStream &stream){
+  previous     = bound_stream;
+  bound_stream = &stream;
+}
+
+
+RandomStreamBinding::~RandomStreamBinding(){
+  bound_stream = previous;
+}
+
+
+//Returns the stream which draws should currently come from
+static RandomStream& current_stream(){
+  if(bound_stream)
+    return *bound_stream;
+  return default_stream();
+}
+
+
+our_random_engine& rand_engine(){
+  return current_stream().engine;
+}
+
+
+//Be sure to read: http://www.pcg-random.org/posts/cpps-random_device.html
+unsigned long seed_rand(unsigned long seed){
+  if(seed==0){
+    std::random_device r;
+    seed = ((unsigned long)r()<<32) | r();
   }
+  global_seed = seed;
+
+  #pragma omp parallel //All threads must reseed their default streams
+  default_stream().seed(DEFAULT_STREAM_BASE+omp_get_thread_num());
+
+  return seed;
+}
+
+
+unsigned long rand_seed(){
+  return global_seed;
 }
 
 
 int uniform_rand_int(int from, int thru){
-  static std::uniform_int_distribution<> d[PRNG_THREAD_MAX];
-  using parm_t = std::uniform_int_distribution<>::param_type;
-  return d[omp_get_thread_num()]( rand_engine(), parm_t{from, thru} );
+  return UniformInt(rand_engine(), from, thru);
 }
 
 
 double uniform_rand_real(double from, double thru){
-  static std::uniform_real_distribution<> d[PRNG_THREAD_MAX];
-  using parm_t = std::uniform_real_distribution<>::param_type;
-  return d[omp_get_thread_num()]( rand_engine(), parm_t{from, thru} );
+  return UniformReal(rand_engine(), from, thru);
 }
 
 
 double normal_rand(double mean, double stddev){
-  static std::normal_distribution<double> d[PRNG_THREAD_MAX];
   using parm_t = std::normal_distribution<double>::param_type;
-  return d[omp_get_thread_num()]( rand_engine(), parm_t{mean, stddev} );
-}
\ No newline at end of file
+  RandomStream &s = current_stream();
+  return s.normal( s.engine, parm_t{mean, stddev} );
+}
+
+
+void uniform_rand_reals(double *out, unsigned int n, double from, double thru){
+  FillUniform(rand_engine(), out, n, from, thru);
+}
+
+
+void normal_rands(double *out, unsigned int n, double mean, double stddev){
+  FillNormal(rand_engine(), out, n, mean, stddev);
+}
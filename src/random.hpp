@@ -1,11 +1,14 @@
 //This file contains a number of functions for getting seeding random number
 //generators and pulling numbers from them in a thread-safe manner.
+//
+//Random numbers are drawn from streams. Each simulation owns its own stream,
+//which is derived from the global seed and the simulation's run number. While a
+//simulation runs it binds its stream to the calling thread, so the functions
+//below draw from it. Results therefore do not depend on which thread, or how
+//many threads, ran the simulation.
 #ifndef _prng_header
 #define _prng_header
 
-///Maximum number of threads this class should deal with
-#define PRNG_THREAD_MAX 32
-
 #ifdef _OPENMP
   #include <omp.h>
 #else
@@ -14,15 +17,95 @@
   #define omp_get_max_threads() 1
 #endif
 
+#include "prng_engines.hpp"
+#include <cmath>
+#include <cstddef>
 #include <random>
+#include <limits>
+#include <istream>
+#include <ostream>
+
+//The engine used by all of the streams is chosen at compile time. Define one of
+//PRNG_MT19937, PRNG_PCG64 or PRNG_PHILOX to pick an engine; otherwise
+//xoshiro256++ is used. See prng_engines.hpp and bench.cpp.
+//PRNG_ENGINE_NAME identifies the engine in checkpoints.
+#if defined(PRNG_MT19937)
+  typedef std::mt19937 our_random_engine;
+  #define PRNG_ENGINE_NAME "mt19937"
+#elif defined(PRNG_PCG64)
+  typedef Pcg64        our_random_engine;
+  #define PRNG_ENGINE_NAME "pcg64"
+#elif defined(PRNG_PHILOX)
+  typedef Philox4x64   our_random_engine;
+  #define PRNG_ENGINE_NAME "philox4x64"
+#else
+  typedef Xoshiro256pp our_random_engine;
+  #define PRNG_ENGINE_NAME "xoshiro256pp"
+#endif
+
+///A reproducible stream of random numbers identified by the global seed and a
+///stream number
+class RandomStream {
+ private:
+  ///Streams belonging to different threads are often allocated next to each
+  ///other. Padding keeps them on separate cache lines to avoid false sharing.
+  char pad_front[64];
+
+ public:
+  ///Seeds the stream using the global seed (see seed_rand()) and the given
+  ///stream number
+  RandomStream(unsigned long stream=0);
+
+  ///Reseeds the stream using the global seed and the given stream number
+  void seed(unsigned long stream);
+
+  ///Reseeds the stream using the global seed, the given stream number, and a
+  ///substream number. Used to give each part of a simulation, such as each
+  ///mountain bin, its own stream.
+  void seed(unsigned long stream, unsigned long substream);
+
+  ///The engine which generates the stream
+  our_random_engine engine;
+
+  ///Normal distributions generate values in pairs and cache the second one. The
+  ///cache is part of the stream's state, so it lives here.
+  std::normal_distribution<double> normal;
 
-typedef std::mt19937 our_random_engine;
+  ///Writes the stream's state, including any cached normal value, to a
+  ///checkpoint. See checkpoint.hpp.
+  void save(std::ostream &out) const;
 
-//Returns a PRNG engine specific to the calling thread
+  ///Restores a state written by save(). The stream then continues exactly as
+  ///the saved stream would have.
+  void load(std::istream &in);
+
+ private:
+  char pad_back[64];
+};
+
+///Binds a stream to the calling thread for the lifetime of this object. While
+///bound, all of the functions below draw from the stream. The previously bound
+///stream is restored on destruction.
+class RandomStreamBinding {
+ private:
+  RandomStream *previous;
+  RandomStreamBinding(const RandomStreamBinding&);             ///Prevent copying
+  RandomStreamBinding& operator=(const RandomStreamBinding&);  ///Prevent assignment
+ public:
+  RandomStreamBinding(RandomStream &stream);
+  ~RandomStreamBinding();
+};
+
+//Returns the PRNG engine of the stream bound to the calling thread
 our_random_engine& rand_engine();
 
-//Seeds the PRNG engines using entropy from the computer's random device
-void seed_rand(unsigned long seed);
+//Sets the global seed from which all streams are derived and reseeds each
+//thread's default stream. A seed of 0 draws a seed using entropy from the
+//computer's random device. Returns the seed used.
+unsigned long seed_rand(unsigned long seed);
+
+//Returns the global seed set by seed_rand()
+unsigned long rand_seed();
 
 //Returns an integer value on the closed interval [from,thru]
 //Thread-safe
@@ -36,11 +119,53 @@ double uniform_rand_real(double from, double thru);
 //deviation. Thread-safe
 double normal_rand(double mean, double stddev);
 
+//Fills out[0..n) with floating-point values on the interval [from,thru). Much
+//faster than calling uniform_rand_real() n times. Thread-safe
+void uniform_rand_reals(double *out, unsigned int n, double from, double thru);
+
+//Fills out[0..n) with Gaussian-distributed values with specified mean and
+//standard deviation. Thread-safe
+void normal_rands(double *out, unsigned int n, double mean, double stddev);
+
 template<class T>
 T uniform_bits(){
-  std::uniform_int_distribution<T> 
+  std::uniform_int_distribution<T>
     dist(std::numeric_limits<T>::lowest(),std::numeric_limits<T>::max());
   return dist( rand_engine() );
 }
 
+//Calls f(i), in increasing order, for each i in [0,n) chosen independently
+//with probability p. Rather than drawing a random number for each i, we draw
+//the geometrically distributed gaps between the chosen i, so about one random
+//number is drawn per i chosen. Thread-safe
+template<class F>
+void for_each_bernoulli(std::size_t n, double p, F f){
+  if(p<=0 || n==0)
+    return;
+  if(p>=1){
+    for(std::size_t i=0;i<n;i++)
+      f(i);
+    return;
+  }
+
+  //Cache 1/log(1-p) since p rarely changes between calls
+  static thread_local double last_p    = -1;
+  static thread_local double inv_log_q = 0;
+  if(p!=last_p){
+    last_p    = p;
+    inv_log_q = 1/std::log1p(-p);
+  }
+
+  //The number of i skipped before the next one chosen is
+  //floor(log(U)/log(1-p)) for U uniform on (0,1]
+  std::size_t i = 0;
+  while(true){
+    const double skip = std::floor(std::log1p(-uniform_rand_real(0,1))*inv_log_q);
+    if(skip>=n-i) break;
+    i += (std::size_t)skip;
+    f(i);
+    if(++i==n) break;
+  }
+}
+
 #endif
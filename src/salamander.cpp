@@ -2,6 +2,7 @@
 #include "random.hpp"
 #include "params.hpp"
 #include <cstdlib>
+#include <cmath>
 #include <functional>
 #include <iostream>
 using namespace std;
@@ -13,7 +14,7 @@ Salamander::Salamander(){
 }
 
 
-Salamander Salamander::breed(const Salamander &b) const {
+Salamander Salamander::breed(const Salamander &b, const Params &params) const {
   //The child starts out as a copy of one of its parents. We modify that copy to
   //build up the child.
   Salamander child=*this;
@@ -25,7 +26,7 @@ Salamander Salamander::breed(const Salamander &b) const {
 
   //Child optimum temperature is the average of its parents, plus a mutation,
   //drawn from a standard normal distribution with mean = 0 and sd = 0.001.
-  child.otempdegC = (otempdegC+b.otempdegC)/2+normal_rand(0,TheParams.tempDrift());
+  child.otempdegC = (otempdegC+b.otempdegC)/2+normal_rand(0,params.tempDrift());
 
   //Find those genes the parents do not have in common.
   Salamander::genetype not_common_genes = (genes ^ b.genes);
@@ -55,19 +56,31 @@ Salamander Salamander::breed(const Salamander &b) const {
   child.genes ^= selected_uncommon;
 
   //Mutate child genome
-  child.mutate();
+  child.mutate(params.mutationProb());
 
   return child;
 }
 
 
-//Walk through the salamander's genome and with a probability
-//`mutation_probability` flip the gene.
-void Salamander::mutate(){
-  std::bernoulli_distribution d(TheParams.mutationProb());
-  for(unsigned int i=0;i<genes.size();i++)
-    if(d(rand_engine()))
-      genes[i].flip();
+//Returns a bit field of any std::bitset type in which each bit is on,
+//independently, with probability p. Since p is small, most bits are off, so
+//the bits which are on are found by skipping the gaps between them (see
+//for_each_bernoulli()). The expected number of random numbers drawn is
+//therefore about one more than the number of bits set.
+template<class Bits>
+static Bits SparseRandomMask(double p){
+  Bits mask;
+  for_each_bernoulli(mask.size(), p, [&](std::size_t pos){
+    mask.set(pos);
+  });
+  return mask;
+}
+
+
+//Flip each gene of the salamander's genome with probability
+//`mutation_prob`. The flips are generated directly as a mask.
+void Salamander::mutate(double mutation_prob){
+  genes ^= SparseRandomMask<Salamander::genetype>(mutation_prob);
 }
 
 
@@ -78,7 +91,18 @@ bool Salamander::pSimilarGenome(
   int species_sim_thresh
 ) const {
   //Create genetype where only the bits which match in genes and b are on
-  Salamander::genetype combined=~(genes ^ b);
+  return pSimilarGenome(genes, b, species_sim_thresh);
+}
+
+
+//Determine whether two bare genomes are more similar than the given threshold.
+bool Salamander::pSimilarGenome(
+  const Salamander::genetype &a,
+  const Salamander::genetype &b,
+  int species_sim_thresh
+){
+  //Create genetype where only the bits which match in a and b are on
+  Salamander::genetype combined=~(a ^ b);
 
   //Were enough bits shared? 
   return combined.count() >= (unsigned int)species_sim_thresh;
@@ -96,10 +120,12 @@ bool Salamander::pSimilar(const Salamander &b, int species_sim_thresh) const {
 //Calculate probability of death given square distance between temperature at
 //time t, and topt for this salamander. Return TRUE if salamander dies.
 bool Salamander::pDie(
+  const double otempdegC,
   const double tempdegC,
   const double conspecific_abundance,
-  const double heterospecific_abundance
-) const {
+  const double heterospecific_abundance,
+  const Params &params
+){
   //Parameters for a logit curve, that kills a salamander with ~50% probability
   //if it is more than 8 degrees C from its optimum temperature, and with ~90%
   //probability if it is more than 12 degrees from its optimum temperature.
@@ -115,9 +141,9 @@ bool Salamander::pDie(
   //Logit function, centered at f(dtemp=0)=0.1; f(dtemp=12**2)=0.9
   const double pdeath = 1/(1+exp(-
     (
-      TheParams.logitOffset()+dtemp*TheParams.logitTempWeight()
-      +conspecific_abundance   *TheParams.logitCAweight()
-      +heterospecific_abundance*TheParams.logitHAweight()
+      params.logitOffset()+dtemp*params.logitTempWeight()
+      +conspecific_abundance   *params.logitCAweight()
+      +heterospecific_abundance*params.logitHAweight()
     )
   ));
 
@@ -20,8 +20,9 @@ class Salamander {
   ///Breed this salamander with another to make a baby! Returns a child
   ///salamander. Child's optimum temperature is the average of its parents,
   ///plus a mutation, drawn from a standard normal distribution. Child genome
-  ///is based on a merge of the bit fields of the parents' genomes.
-  Salamander breed(const Salamander &b) const;
+  ///is based on a merge of the bit fields of the parents' genomes. The size of
+  ///these mutations is taken from params.
+  Salamander breed(const Salamander &b, const Params &params) const;
 
 
   ///Determine whether two salamander genomes are similar. If the genomes are
@@ -38,21 +39,33 @@ class Salamander {
   ///species. Returns TRUE if genes are of the same species.
   bool pSimilarGenome(const Salamander::genetype &b, int species_sim_thresh) const;
 
+  ///As above, but compares two bare genomes. Used where the salamanders are
+  ///stored as a structure of arrays (see Population) rather than as objects.
+  static bool pSimilarGenome(
+    const Salamander::genetype &a,
+    const Salamander::genetype &b,
+    int species_sim_thresh
+  );
+
   ///Mutate this salamander's genome. Flips each element of the bit field with
-  ///probability mutation_probability.
-  void mutate();
+  ///probability mutation_prob. The flips are drawn as a sparse mask, so the
+  ///cost depends on the number of flips rather than on the genome's size.
+  void mutate(double mutation_prob);
 
   ///Determines whether a salamander dies given an input temperature and its
   ///optimum temperature. Based on a logit curve, parameterized such that a
   ///salamander dies with ~50% probability if it is more than 8 degrees C from
   ///its optimum temperature, and with ~90% probability if it is more than 12
   ///degrees from its optimum temperature. Returns TRUE if the salamander
-  ///dies.
-  bool pDie(
+  ///dies. Only the salamander's optimal temperature is needed, so it is passed
+  ///in directly. The logit weights are taken from params.
+  static bool pDie(
+    const double otempdegC,
     const double tempdegC,
     const double conspecific_abundance,
-    const double heterospecific_abundance
-  ) const;
+    const double heterospecific_abundance,
+    const Params &params
+  );
 
   ///Neutral genes. Determined by the parents of the salamander and used to
   ///determine if the salamander is of the same species as another salamander.
@@ -0,0 +1,35 @@
+#include "scheduler.hpp"
+#include "params.hpp"
+#include <algorithm>
+#include <iomanip>
+
+EnsembleScheduler::EnsembleScheduler(int threads) : next_task(0), active(0) {
+  this->threads = std::max(threads,1);
+}
+
+
+int EnsembleScheduler::binThreads() const {
+  if(next_task<ntasks)
+    return TheParams.binThreads();
+  //Every simulation has been started, so the threads which are not running one
+  //are idle. Divide the team among the simulations which are still running.
+  const int running = std::max(active.load(),1);
+  return std::max(TheParams.binThreads(), threads/running);
+}
+
+
+void EnsembleScheduler::printUtilization(std::ostream &out){
+  const double total = wall.accumulated();
+  const std::ios::fmtflags flags     = out.flags();
+  const std::streamsize    precision = out.precision();
+  out<<"Thread  Runs  Busy(s)  Utilization\n";
+  for(int t=0;t<threads;t++){
+    const double b = busy[t].accumulated();
+    out<<std::setw(6)<<t            <<"  "
+       <<std::setw(4)<<tasks_run[t] <<"  "
+       <<std::setw(7)<<std::fixed<<std::setprecision(2)<<b<<"  "
+       <<std::setw(10)<<std::setprecision(1)<<(total>0 ? 100*b/total : 0)<<"%\n";
+  }
+  out.flags(flags);
+  out.precision(precision);
+}
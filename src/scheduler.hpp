@@ -0,0 +1,94 @@
+#ifndef _scheduler_hpp_
+#define _scheduler_hpp_
+
+#include "timer.hpp"
+#include <atomic>
+#include <vector>
+#include <ostream>
+#include "omp.h"
+
+//EnsembleScheduler runs the simulations of an ensemble on a team of threads.
+//Whenever a thread finishes a simulation it takes the next one which has not
+//been started, so threads which draw quick simulations, such as those which go
+//extinct early, go on to do more of them. Once every simulation has been
+//started, the threads which have run out of work lend themselves to the
+//simulations still running, which use them to process their bins (see
+//binThreads()). The time each thread spends running simulations is recorded so
+//that its utilization can be reported.
+class EnsembleScheduler {
+ private:
+  //Number of threads in the team
+  int threads;
+
+  //Number of simulations in the ensemble
+  int ntasks = 0;
+
+  //Index of the next simulation to be started
+  std::atomic<int> next_task;
+
+  //Number of threads still running a simulation
+  std::atomic<int> active;
+
+  //Time each thread has spent running simulations
+  std::vector<Timer> busy;
+
+  //Number of simulations each thread has run
+  std::vector<int>   tasks_run;
+
+  //Time from the start to the end of the ensemble
+  Timer wall;
+
+ public:
+  //Creates a scheduler which will use the given number of threads
+  EnsembleScheduler(int threads);
+
+  //Runs task(i) for each i in [0,ntasks), with tasks started in order of i.
+  //Returns once all of them have finished.
+  template<class F>
+  void run(int ntasks, F task);
+
+  //Number of threads a simulation should use to process its bins at this
+  //moment. This is the BinThreads parameter until every simulation has been
+  //started, after which the team's threads are shared among the simulations
+  //still running. The results of a simulation do not depend on this number.
+  int binThreads() const;
+
+  //Prints each thread's share of the ensemble's running time
+  void printUtilization(std::ostream &out);
+};
+
+
+
+template<class F>
+void EnsembleScheduler::run(int ntasks, F task){
+  this->ntasks = ntasks;
+  next_task    = 0;
+  busy.assign(threads, Timer());
+  tasks_run.assign(threads, 0);
+
+  //Threads idle in the simulations' bin loops would otherwise be unavailable
+  if(threads>1)
+    omp_set_max_active_levels(2);
+
+  wall.reset();
+  wall.start();
+  #pragma omp parallel num_threads(threads)
+  {
+    //The team may be smaller than requested
+    #pragma omp single
+    active = omp_get_num_threads();
+
+    const int me = omp_get_thread_num();
+    int i;
+    while((i=next_task++)<ntasks){
+      busy[me].start();
+      task(i);
+      busy[me].stop();
+      tasks_run[me]++;
+    }
+    active--;
+  }
+  wall.stop();
+}
+
+#endif
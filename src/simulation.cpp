@@ -6,24 +6,192 @@
 #include <iomanip>
 #include <limits>
 #include <cassert>
+#include <exception>
+#include "timer.hpp"
+#include "checkpoint.hpp"
+#include "timeline.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cmath>
+#include <sstream>
+#include <iterator>
+
+Simulation::Simulation(int run_num, const Params &params, int param_set) : params(params) {
+  this->run_num   = run_num;
+  this->param_set = param_set;
+}
+
+
+//Replaces filename with the given contents. The contents are written to a
+//temporary file which is then renamed, so the file is never left half-written.
+static void ReplaceFile(const std::string &filename, const std::string &contents){
+  const std::string tmpname = filename+".tmp";
+  {
+    std::ofstream out(tmpname, std::ios::binary);
+    if(!out.good()){
+      std::cerr<<"Could not open '"<<tmpname<<"' for writing!"<<std::endl;
+      throw std::runtime_error("Could not open file for writing!");
+    }
+    out.write(contents.data(), contents.size());
+    out.close();
+    if(out.fail()){
+      std::cerr<<"Could not write '"<<tmpname<<"'!"<<std::endl;
+      throw std::runtime_error("Could not write file!");
+    }
+  }
+  if(std::rename(tmpname.c_str(), filename.c_str())!=0){
+    std::cerr<<"Could not replace '"<<filename<<"'!"<<std::endl;
+    throw std::runtime_error("Could not replace file!");
+  }
+}
+
+
+
+//Returns the first multiple of interval after t, or 0 if interval is 0
+static double NextMultiple(double t, double interval){
+  if(interval==0)
+    return 0;
+  double next = interval;
+  while(TimeReached(t, next))
+    next += interval;
+  return next;
+}
+
+
+
+//Disperse salamanders in two phases. First every bin decides which of its
+//salamanders leave, and for where, and moves them into its outbox. Then every
+//bin appends the salamanders bound for it from each outbox, in bin order. No
+//bin is written during the first phase except by its own thread, and none is
+//read during the second except by the thread appending to it, so both phases
+//run in parallel and the result does not depend on the order of the bins.
+void Simulation::disperseOutbox(const Environment::Step &env, int bin_threads){
+  //The lowlands are the destination numbered one past the last bin
+  const unsigned int lowlands = mts.size();
+  const unsigned int ndest    = mts.size()+1;
+
+  #pragma omp parallel for num_threads(bin_threads) if(bin_threads>1) schedule(dynamic)
+  for(unsigned int m=0;m<mts.size();m++){
+    RandomStreamBinding bin_binding(mts[m].rng);
+    if(params.dispersalType()==DISPERSAL_BETTER)
+      mts[m].emigrateToBetter(env, mts, m);
+    else if(params.dispersalType()==DISPERSAL_MAYBE_WORSE)
+      mts[m].emigrateLocal   (env, mts, m);
+    else if(params.dispersalType()==DISPERSAL_GLOBAL)
+      mts[m].emigrateGlobal  (env, mts, m);
+  }
+
+  //Immigrants are appended after the salamanders already in a bin, so the
+  //front range's first front_residents salamanders are those which were there
+  //at the start of dispersal and have not left
+  const unsigned int front_residents = mts[0].alive();
+
+  #pragma omp parallel for num_threads(bin_threads) if(bin_threads>1) schedule(dynamic)
+  for(unsigned int d=0;d<mts.size();d++)
+  for(unsigned int m=0;m<mts.size();m++)
+    mts[d].immigrateFrom(mts[m], d);
+
+  //The exchange with the lowlands follows the same two phases. Since the front
+  //range and the lowlands decide at the same time, no coin flip is needed to
+  //decide which goes first. Only the front range's residents may leave for the
+  //lowlands, so that the salamanders which have just arrived from elsewhere on
+  //the mountain do not move twice.
+  {
+    RandomStreamBinding b(mts[0].rng);
+    mts[0].emigrateTo(params.toLowlandsProb(), lowlands, ndest, front_residents);
+  }
+  {
+    RandomStreamBinding b(surrounding_lowlands.rng);
+    surrounding_lowlands.emigrateTo(params.toLowlandsProb(), 0, ndest, surrounding_lowlands.alive());
+  }
+  surrounding_lowlands.immigrateFrom(mts[0], lowlands);
+  mts[0].immigrateFrom(surrounding_lowlands, 0);
+}
+
+
+
+//A simulation which fails, such as by overpopulating a bin, is recorded as
+//such rather than bringing down the rest of the ensemble
+void Simulation::runSimulation(const EnsembleScheduler *scheduler){
+  try {
+    simulate(scheduler);
+  } catch (const std::exception &e) {
+    std::cerr<<"Run "<<run_num<<" failed: "<<e.what()<<std::endl;
+    status = "Failed";
+    ecdf   = std::numeric_limits<double>::quiet_NaN();
+    mts.clear();
+    mts.shrink_to_fit();
+  }
+}
+
+
+
+//Returns the reason the simulation should be pruned after the given number of
+//steps, ending at time tMyrs, or an empty string if it should continue. See
+//Params::pruneCheckInterval(). next_check is the time of the next check of the
+//population and species bounds, and is advanced past tMyrs when one is made.
+std::string Simulation::pruneReason(double tMyrs, int steps, double seconds, double &next_check) const {
+  if(params.pruneMaxSteps()>0 && steps>=params.pruneMaxSteps())
+    return "Steps";
+  if(params.pruneMaxSeconds()>0 && seconds>=params.pruneMaxSeconds())
+    return "Seconds";
+
+  if(params.pruneCheckInterval()==0 || !TimeReached(tMyrs, next_check))
+    return "";
+  while(TimeReached(tMyrs, next_check))
+    next_check += params.pruneCheckInterval();
+
+  const int nalive = alive()+surrounding_lowlands.alive();
+  if(nalive<params.pruneMinAlive())
+    return "MinAlive";
+  if(params.pruneMaxAlive()>0 && nalive>params.pruneMaxAlive())
+    return "MaxAlive";
+
+  const int living_species = phylos.livingSpecies(tMyrs);
+  if(living_species<params.pruneMinSpecies())
+    return "MinSpecies";
+  if(params.pruneMaxSpecies()>0 && living_species>params.pruneMaxSpecies())
+    return "MaxSpecies";
+
+  if(params.pruneMaxECDF()>=0 && tMyrs>=params.pruneECDFStart())
+    if(phylos.compareECDF(tMyrs)>params.pruneMaxECDF())
+      return "ECDF";
+
+  return "";
+}
+
+
+
+void Simulation::simulate(const EnsembleScheduler *scheduler){
+  //Time spent running, for Params::pruneMaxSeconds()
+  Timer wall;
+  wall.start();
 
-void Simulation::runSimulation(){
   //65Mya the Appalachian Mountains were 2.8km tall. Initialize each bin to
   //point to its given elevation band.
-  mts.reserve(TheParams.numBins());
-  for(int m=0;m<TheParams.numBins();m++)
-    mts.push_back(MtBin(m*2.8/TheParams.numBins()));
+  mts.reserve(params.numBins());
+  for(int m=0;m<params.numBins();m++)
+    mts.push_back(MtBin(m*2.8/params.numBins(), params));
+  surrounding_lowlands = MtBin(0, params);
 
-  //Cache species_sim_thresh for speed
-  const int species_sim_thresh = TheParams.speciesSimthresh();
-
-  //This vector is shuffled before each dispersion event to ensure that there is
-  //no bias towards upwards or downards movement on the mountain
-  std::vector<unsigned int> mtbin_order;
-  for(unsigned int i=0;i<mts.size();i++)
-    mtbin_order.push_back(i);
+  //Draw this simulation's random numbers from its own streams
+  seedStreams();
+  RandomStreamBinding rng_binding(rng);
 
-  if(TheParams.initialAltitude()<0 || (int)mts.size()<=TheParams.initialAltitude()){
+  //Cache species_sim_thresh for speed
+  const int species_sim_thresh = params.speciesSimthresh();
+
+  //Local dispersal only moves salamanders between neighbouring bins, so bins
+  //whose indices differ by three or more never touch the same bins. We split
+  //the bins into three colour classes by index modulo 3. All the bins of a
+  //class can disperse at the same time, and the order in which the classes are
+  //visited is shuffled each step to ensure that there is no bias towards
+  //upwards or downwards movement on the mountain.
+  assert(mts.size()>2);
+  int colour_order[3] = {0,1,2};
+
+  if(params.initialAltitude()<0 || (int)mts.size()<=params.initialAltitude()){
     std::cerr<<"Initial bin was outside of range. ";
     std::cerr<<"Should be in [0,"<<(mts.size()-1)<<"]."<<std::endl;
     throw std::runtime_error("Initial bin outside of range.");
@@ -44,7 +212,7 @@ void Simulation::runSimulation(){
   //mountains. We ensure that Eve is well-adapted for her time by setting her
   //optimal temperature to be equal to the temperature of the bin she starts in.
   Eve.otempdegC = Temperature.getTemp(0) - 
-                      9.8*mts[TheParams.initialAltitude()].heightkm();
+                      9.8*mts[params.initialAltitude()].heightkm();
 
   //We set Eve initially to have a genome in which all of the bits are off.
   //Since the genomes are used solely to determine speciation and speciation is
@@ -55,8 +223,8 @@ void Simulation::runSimulation(){
   //We populate the first (lowest) mountain bin with some Eve-clones. We
   //populate only the lowest mountain bin because that mountain bin will have a
   //temperature close to the global average which is optimal for Eve (see above).
-  for(int s=0;s<TheParams.initialPopSize();++s)
-    mts[TheParams.initialAltitude()].addSalamander(Eve);
+  for(int s=0;s<params.initialPopSize();++s)
+    mts[params.initialAltitude()].addSalamander(Eve);
 
   //Begin a new phylogeny with Eve as the root
   phylos = Phylogeny(Eve, 0);
@@ -68,86 +236,235 @@ void Simulation::runSimulation(){
   //Loop over years, starting at t=0, which corresponds to 65 million years ago.
   //tMyrs is in units of millions of years
   double tMyrs=0;
-  for(tMyrs=0;tMyrs<65.001;tMyrs+=TheParams.timestep()){
+
+  //Number of timesteps which have fallen in the statistics window so far. See
+  //Params::statsRecording()
+  int steps_in_window = 0;
+
+  //Number of timesteps taken, and time of the next pruning check. See
+  //Params::pruneCheckInterval()
+  int    steps      = 0;
+  double next_check = params.pruneCheckInterval();
+
+  //Time of the next checkpoint, and the wall-clock time spent running before
+  //this simulation was resumed from a checkpoint. See
+  //Params::checkpointInterval()
+  double next_checkpoint = params.checkpointInterval();
+  double seconds_before  = 0;
+
+  //Time from which the timesteps of this simulation are counted: 0, or the
+  //time of the shared history from which it was forked
+  double origin = 0;
+
+  //The progress of the main loop, as saved in checkpoints and snapshots
+  auto current_progress = [&](){
+    Progress progress;
+    progress.tMyrs           = tMyrs;
+    progress.origin          = origin;
+    progress.steps_in_window = steps_in_window;
+    progress.steps           = steps;
+    progress.next_check      = next_check;
+    progress.next_checkpoint = next_checkpoint;
+    progress.seconds         = seconds_before+wall.lap();
+    std::copy(colour_order, colour_order+3, progress.colour_order);
+    return progress;
+  };
+
+  //The loop carries on from the step after the given progress, advancing time
+  //just as it would have
+  auto continue_from = [&](const Progress &progress){
+    tMyrs           = progress.tMyrs+params.timestep();
+    origin          = progress.origin;
+    steps_in_window = progress.steps_in_window;
+    steps           = progress.steps;
+    next_check      = progress.next_check;
+    next_checkpoint = progress.next_checkpoint;
+    seconds_before  = progress.seconds;
+    std::copy(progress.colour_order, progress.colour_order+3, colour_order);
+  };
+
+  //Pick up where an earlier run of this simulation left off. The results are
+  //the same as if the simulation had never stopped. Failing that, a forked
+  //simulation picks up from the end of the shared history, with its own random
+  //number streams. See Params::forkTime().
+  Progress progress;
+  if(params.checkpointInterval()>0 && loadCheckpoint(progress)){
+    std::cerr<<"Run "<<run_num<<" resuming from its checkpoint at "
+             <<progress.tMyrs<<" Myr"<<std::endl;
+    continue_from(progress);
+  } else if(fork_from){
+    std::istringstream in(*fork_from);
+    readState(in, progress, true);
+    seedStreams();
+    //The checks are made on this simulation's schedule from here on
+    progress.next_check      = NextMultiple(progress.tMyrs, params.pruneCheckInterval());
+    progress.next_checkpoint = NextMultiple(progress.tMyrs, params.checkpointInterval());
+    progress.seconds         = 0;
+    progress.origin          = progress.tMyrs;
+    continue_from(progress);
+  }
+
+  //The environment of the bins at each timestep. See Environment.
+  std::vector<double> heights;
+  for(const auto &m: mts)
+    heights.push_back(m.heightkm());
+  const std::shared_ptr<const Environment> environment = Environment::Shared(heights, params, origin);
+
+  for(;BeforeEndOfTime(tMyrs);tMyrs+=params.timestep()){
+    //Kept up to date so that a simulation which fails records when it did
+    endtime = tMyrs;
+
     //This requires a linear walk of all the bins on the mountain. Hence, it's a
     //little expensive. But it prevents many walks below if all the salamanders
     //go extinct early on. Therefore, in a parameter space where many
     //populations won't make it, this is a worthwhile thing to do.
-    if(alive()+surrounding_lowlands.alive()==0) break;
+    if(alive()+surrounding_lowlands.alive()==0){
+      status = "Extinct";
+      break;
+    }
 
-    if(TheParams.debug())
+    if(params.debug())
       printMt(tMyrs);
 
-    //Visit death upon each bin
-    for(auto &m: mts)
-      m.mortaliate(tMyrs, phylos.nodes.size(), species_sim_thresh);
-
-    //Ensure that there are no Sky Salamanders in the simulation. Mountains
-    //erode over time, the bins which are above the mountains' actual heights
-    //must be emptied of their inhabitants.
-    for(auto &m: mts)
-      if(m.heightkm()>=MtBin::heightMaxKm(tMyrs))
-        m.killAll();
-
-    //Let the salamanders in each bin be fruitful, and multiply
-    for(auto &m: mts)
-      m.breed(tMyrs, species_sim_thresh);
-
-    surrounding_lowlands.breed(tMyrs, species_sim_thresh);
-
-    //Randomize the order in which we visit bins so there is no upwards or
-    //downwards bias to movement. Such a bias could arise, say, by always
-    //considering bins from bottom to top. In this case, a salamander at the
-    //bottom would have an opportunity to move up several bins whereas no
-    //salamander would be able to move downwards more than one bin.
-    //std::random_shuffle() is not thread safe, so we use the Fisher-Yates-
-    //Durstenfeld-Knuth algorithm.
-    assert(mtbin_order.size()>2);
-    for(unsigned int i=0;i<mtbin_order.size()-2;i++){
-      unsigned int j = uniform_rand_int(i,mtbin_order.size()-1);
-      std::swap(mtbin_order[i],mtbin_order[j]);
+    const Environment::Step env = environment->at(tMyrs);
+
+    //Number of threads used to process the bins of this simulation during this
+    //step. This may grow once the rest of the ensemble has finished.
+    const int bin_threads = scheduler ? scheduler->binThreads() : params.binThreads();
+
+    //Each bin is independent of the others during mortality and breeding, so
+    //the bins are processed in parallel. Exceptions cannot leave an OpenMP
+    //region, so the first one thrown is carried out and rethrown below.
+    const int max_species = phylos.nodes.size();
+    std::exception_ptr bin_exception;
+    #pragma omp parallel for num_threads(bin_threads) if(bin_threads>1) schedule(dynamic)
+    for(unsigned int m=0;m<mts.size();m++){
+      RandomStreamBinding bin_binding(mts[m].rng);
+      try {
+        //Visit death upon each bin
+        mts[m].mortaliate(env, m, max_species, species_sim_thresh);
+
+        //Ensure that there are no Sky Salamanders in the simulation. Mountains
+        //erode over time, the bins which are above the mountains' actual
+        //heights must be emptied of their inhabitants.
+        if(env.above_summit[m])
+          mts[m].killAll();
+
+        //Let the salamanders in each bin be fruitful, and multiply
+        mts[m].breed(tMyrs, species_sim_thresh);
+      } catch (...) {
+        #pragma omp critical(bin_exception)
+        if(!bin_exception)
+          bin_exception = std::current_exception();
+      }
+    }
+    if(bin_exception)
+      std::rethrow_exception(bin_exception);
+
+    {
+      RandomStreamBinding lowlands_binding(surrounding_lowlands.rng);
+      surrounding_lowlands.breed(tMyrs, species_sim_thresh);
     }
 
-    //For each bin, offer some salamanders therein the opportunity to migrate up
-    //or down the mountain.
-    if(TheParams.dispersalType()==DISPERSAL_BETTER){
-      for(unsigned int mo=0;mo<mtbin_order.size();++mo){
-        unsigned int m = mtbin_order[mo];
-        if(m==0)                 mts[m].diffuseToBetter(tMyrs, nullptr,   &mts[m+1]);
-        else if(m==mts.size()-1) mts[m].diffuseToBetter(tMyrs, &mts[m-1], nullptr  );
-        else                     mts[m].diffuseToBetter(tMyrs, &mts[m-1], &mts[m+1]);
+    if(params.dispersalStage()==DISPERSAL_STAGE_OUTBOX){
+      disperseOutbox(env, bin_threads);
+    } else {
+      //For each bin, offer some salamanders therein the opportunity to migrate up
+      //or down the mountain.
+      if(params.dispersalType()==DISPERSAL_BETTER || params.dispersalType()==DISPERSAL_MAYBE_WORSE){
+        //Randomize the order in which we visit the colour classes so there is no
+        //upwards or downwards bias to movement. Such a bias could arise, say, by
+        //always considering bins from bottom to top. In this case, a salamander
+        //at the bottom would have an opportunity to move up several bins whereas
+        //no salamander would be able to move downwards more than one bin.
+        for(int i=0;i<2;i++)
+          std::swap(colour_order[i],colour_order[uniform_rand_int(i,2)]);
+
+        for(int c=0;c<3;c++){
+          const int colour = colour_order[c];
+          #pragma omp parallel for num_threads(bin_threads) if(bin_threads>1) schedule(dynamic)
+          for(unsigned int m=colour;m<mts.size();m+=3){
+            RandomStreamBinding bin_binding(mts[m].rng);
+            MtBin *lower = (m==0)            ? nullptr : &mts[m-1];
+            MtBin *upper = (m==mts.size()-1) ? nullptr : &mts[m+1];
+            if(params.dispersalType()==DISPERSAL_BETTER)
+              mts[m].diffuseToBetter(env, m, lower, upper);
+            else
+              mts[m].diffuseLocal   (env, m, lower, upper);
+          }
+        }
+      } else if(params.dispersalType()==DISPERSAL_GLOBAL) {
+        //We don't need to randomize the order for global dispersion since it
+        //contains no bias. Since any bin may send salamanders to any other, the
+        //bins are visited one at a time.
+        for(auto &m: mts){
+          RandomStreamBinding bin_binding(m.rng);
+          m.diffuseGlobal(env, mts);
+        }
       }
-    } else if(TheParams.dispersalType()==DISPERSAL_MAYBE_WORSE) {
-      for(unsigned int mo=0;mo<mtbin_order.size();++mo){
-        unsigned int m = mtbin_order[mo];
-        if(m==0)                 mts[m].diffuseLocal(tMyrs, nullptr,   &mts[m+1]);
-        else if(m==mts.size()-1) mts[m].diffuseLocal(tMyrs, &mts[m-1], nullptr  );
-        else                     mts[m].diffuseLocal(tMyrs, &mts[m-1], &mts[m+1]);
+
+      //Randomize order of execution to smooth biases
+      if(uniform_rand_real(0,1)>=0.5){
+        { RandomStreamBinding b(mts[0].rng);              mts[0].diffuseToLowlands(surrounding_lowlands); }
+        { RandomStreamBinding b(surrounding_lowlands.rng); surrounding_lowlands.diffuseToLowlands(mts[0]); }
+      } else {
+        { RandomStreamBinding b(surrounding_lowlands.rng); surrounding_lowlands.diffuseToLowlands(mts[0]); }
+        { RandomStreamBinding b(mts[0].rng);              mts[0].diffuseToLowlands(surrounding_lowlands); }
       }
-    } else if(TheParams.dispersalType()==DISPERSAL_GLOBAL) {
-      //We don't need to randomize the order for global dispersion since it
-      //contains no bias.
-      for(auto &m: mts)
-        m.diffuseGlobal(tMyrs, mts);
     }
 
-    //Randomize order of execution to smooth biases
-    if(uniform_rand_real(0,1)>=0.5){
-      mts[0].diffuseToLowlands(surrounding_lowlands);
-      surrounding_lowlands.diffuseToLowlands(mts[0]);
-    } else {
-      surrounding_lowlands.diffuseToLowlands(mts[0]);
-      mts[0].diffuseToLowlands(surrounding_lowlands);
+    //Decide whether species' statistics are recorded at this timestep. The
+    //final step is the one after which the loop condition fails.
+    const bool final_step = !BeforeEndOfTime(tMyrs+params.timestep());
+    bool record_stats = true;
+    if(params.statsRecording()==STATS_RECORD_WINDOW){
+      record_stats = false;
+      if(TimeReached(tMyrs, params.statsWindowStart()) && TimeReached(params.statsWindowEnd(), tMyrs))
+        record_stats = (steps_in_window++ % params.statsStride())==0;
+      //The time of the final step may have drifted past 65, or past the end
+      //of the window, but it is the present day and so belongs to any window
+      //which reaches the present
+      if(final_step && params.statsWindowEnd()>=65 && TimeReached(65, params.statsWindowStart()))
+        record_stats = true;
+    } else if(params.statsRecording()==STATS_RECORD_FINAL_STEP){
+      record_stats = final_step;
     }
 
     //Updates the phylogeny based on the current time, living salamanders, and
     //species similarity threshold
-    phylos.UpdatePhylogeny(tMyrs, TheParams.timestep(), mts);
+    phylos.UpdatePhylogeny(tMyrs, params.timestep(), species_sim_thresh, mts, bin_threads, record_stats);
+
+    //Stop simulations which are not worth finishing
+    const std::string prune_reason = pruneReason(tMyrs, ++steps, seconds_before+wall.lap(), next_check);
+    if(!prune_reason.empty()){
+      status = "Pruned:"+prune_reason;
+      break;
+    }
+
+    if(params.checkpointInterval()>0 && TimeReached(tMyrs, next_checkpoint)){
+      while(TimeReached(tMyrs, next_checkpoint))
+        next_checkpoint += params.checkpointInterval();
+      saveCheckpoint(current_progress());
+    }
+
+    //The shared history of a fork ensemble ends at the fork time
+    if(making_snapshot && TimeReached(tMyrs, params.forkTime())){
+      std::ostringstream out;
+      writeState(out, current_progress());
+      snapshot = out.str();
+      status   = "Snapshot";
+      break;
+    }
   }
+  wall.stop();
+
+  //The run is over, so it will never be resumed
+  if(params.checkpointInterval()>0)
+    std::remove(checkpointFilename().c_str());
 
   //Records the time at which the simulation ended
-  if(tMyrs>=65.001)
-    tMyrs-=TheParams.timestep(); //Since the last step goes past the end of time
+  if(!BeforeEndOfTime(tMyrs))
+    tMyrs-=params.timestep(); //Since the last step goes past the end of time
   endtime = tMyrs;
 
   //Records the average optimal temperature of the salamanders alive at present
@@ -175,6 +492,192 @@ void Simulation::runSimulation(){
 }
 
 
+std::string Simulation::checkpointFilename() const {
+  return params.checkpointPrefix()+"_"+std::to_string(run_num)+".ckpt";
+}
+
+
+
+//A checkpoint begins with a header identifying the simulation it belongs to,
+//by its run number, parameter set, bins, timestep, global seed, and a digest of
+//its parameters, which is checked when it is loaded. The progress of the main
+//loop follows, and then the state of the random number streams, bins, and
+//phylogeny. See checkpoint.hpp. Fork snapshots are checkpoints of the shared
+//history.
+void Simulation::writeState(std::ostream &out, const Progress &progress) const {
+  out.write(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+  WriteBinary(out, CHECKPOINT_VERSION);
+  WriteBinary(out, run_num);
+  WriteBinary(out, param_set);
+  WriteBinary(out, (int)mts.size());
+  WriteBinary(out, params.timestep());
+  WriteBinary(out, (std::uint64_t)rand_seed());
+  WriteBinary(out, params.digest());
+
+  WriteBinary(out, progress.tMyrs);
+  WriteBinary(out, progress.steps_in_window);
+  WriteBinary(out, progress.steps);
+  WriteBinary(out, progress.next_check);
+  WriteBinary(out, progress.next_checkpoint);
+  WriteBinary(out, progress.seconds);
+  for(int c=0;c<3;c++)
+    WriteBinary(out, progress.colour_order[c]);
+  WriteBinary(out, progress.origin);
+
+  rng.save(out);
+  for(const auto &m: mts)
+    m.save(out);
+  surrounding_lowlands.save(out);
+  phylos.save(out);
+}
+
+
+
+void Simulation::readState(std::istream &in, Progress &progress, bool fork){
+  char          magic[sizeof(CHECKPOINT_MAGIC)];
+  std::uint32_t version;
+  int           ck_run_num, ck_param_set, ck_numbins;
+  double        ck_timestep;
+  std::uint64_t ck_seed, ck_digest;
+  in.read(magic, sizeof(magic));
+  if(!in || !std::equal(magic, magic+sizeof(magic), CHECKPOINT_MAGIC)){
+    std::cerr<<"Run "<<run_num<<" was given something which is not a checkpoint!"<<std::endl;
+    throw std::runtime_error("Not a checkpoint!");
+  }
+  ReadBinary(in, version);
+  if(version!=CHECKPOINT_VERSION){
+    std::cerr<<"Checkpoint is version "<<version<<", but only version "
+             <<CHECKPOINT_VERSION<<" can be read!"<<std::endl;
+    throw std::runtime_error("Unsupported checkpoint version!");
+  }
+  ReadBinary(in, ck_run_num);
+  ReadBinary(in, ck_param_set);
+  ReadBinary(in, ck_numbins);
+  ReadBinary(in, ck_timestep);
+  ReadBinary(in, ck_seed);
+  ReadBinary(in, ck_digest);
+  //A fork may continue the shared history with different parameters, but it
+  //must have the same bins
+  if(ck_numbins!=(int)mts.size()){
+    std::cerr<<"Checkpoint has "<<ck_numbins<<" bins, but run "<<run_num<<" has "<<mts.size()<<"!"<<std::endl;
+    throw std::runtime_error("Checkpoint has a different number of bins!");
+  }
+  if(!fork && (ck_run_num!=run_num || ck_param_set!=param_set || ck_timestep!=params.timestep())){
+    std::cerr<<"Checkpoint belongs to a different simulation than run "<<run_num<<"!"<<std::endl;
+    throw std::runtime_error("Checkpoint belongs to a different simulation!");
+  }
+  if(!fork && ck_digest!=params.digest()){
+    std::cerr<<"Checkpoint of run "<<run_num<<" was made with different parameters! "
+             <<"Delete it to start the run afresh."<<std::endl;
+    throw std::runtime_error("Checkpoint was made with different parameters!");
+  }
+  if(!fork && ck_seed!=rand_seed()){
+    std::cerr<<"Checkpoint of run "<<run_num<<" was made with PRNG seed "<<ck_seed
+             <<", not "<<rand_seed()<<"! Set PRNGseed to "<<ck_seed
+             <<" to resume it, or delete it to start the run afresh."<<std::endl;
+    throw std::runtime_error("Checkpoint was made with a different seed!");
+  }
+
+  ReadBinary(in, progress.tMyrs);
+  ReadBinary(in, progress.steps_in_window);
+  ReadBinary(in, progress.steps);
+  ReadBinary(in, progress.next_check);
+  ReadBinary(in, progress.next_checkpoint);
+  ReadBinary(in, progress.seconds);
+  for(int c=0;c<3;c++)
+    ReadBinary(in, progress.colour_order[c]);
+  ReadBinary(in, progress.origin);
+
+  rng.load(in);
+  for(auto &m: mts)
+    m.load(in);
+  surrounding_lowlands.load(in);
+  phylos.load(in);
+}
+
+
+
+void Simulation::saveCheckpoint(const Progress &progress) const {
+  std::ostringstream out;
+  writeState(out, progress);
+  ReplaceFile(checkpointFilename(), out.str());
+}
+
+
+
+bool Simulation::loadCheckpoint(Progress &progress){
+  std::ifstream in(checkpointFilename(), std::ios::binary);
+  if(!in.good())
+    return false;
+  readState(in, progress, false);
+  return true;
+}
+
+
+
+//The shared history is simulated as run -1, so its random numbers are drawn
+//from a stream which no simulation of the ensemble uses. An existing snapshot
+//is checked as run -1 would check its own checkpoint, so one made with other
+//base parameters or another seed is refused.
+std::string Simulation::ForkSnapshot(const Params &params){
+  {
+    std::ifstream fin(params.forkSnapshotFilename(), std::ios::binary);
+    if(fin.good()){
+      std::string snapshot((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+      //Check that the snapshot was taken of this history at the fork time
+      Simulation check(-1, params);
+      for(int m=0;m<params.numBins();m++)
+        check.mts.push_back(MtBin(m*2.8/params.numBins(), params));
+      Progress progress;
+      std::istringstream in(snapshot);
+      try {
+        check.readState(in, progress, false);
+      } catch (const std::runtime_error&) {
+        std::cerr<<"Fork snapshot '"<<params.forkSnapshotFilename()<<"' cannot be used! "
+                 <<"Delete it to simulate the shared history afresh."<<std::endl;
+        throw;
+      }
+      //The history stops at the first step at or after the fork time, which
+      //need not fall on the fork time itself. Its time is accumulated exactly
+      //as in the main loop.
+      double fork_step = 0;
+      while(!TimeReached(fork_step, params.forkTime()))
+        fork_step += params.timestep();
+      if(progress.tMyrs!=fork_step){
+        std::cerr<<"Fork snapshot '"<<params.forkSnapshotFilename()<<"' was taken at "
+                 <<progress.tMyrs<<" Myr, not at "<<fork_step<<" Myr, the first step at or after the ForkTime of "
+                 <<params.forkTime()<<" Myr!"<<std::endl;
+        throw std::runtime_error("Fork snapshot was taken at the wrong time!");
+      }
+      std::cerr<<"Forking from the snapshot in '"<<params.forkSnapshotFilename()<<"'"<<std::endl;
+      return snapshot;
+    }
+  }
+
+  std::cerr<<"Simulating the shared history up to "<<params.forkTime()<<" Myr"<<std::endl;
+  Simulation shared(-1, params);
+  shared.making_snapshot = true;
+  shared.simulate(nullptr);
+  if(shared.snapshot.empty()){
+    std::cerr<<"The shared history ended ("<<shared.status<<") before the ForkTime of "
+             <<params.forkTime()<<" Myr!"<<std::endl;
+    throw std::runtime_error("The shared history ended before the fork time!");
+  }
+  ReplaceFile(params.forkSnapshotFilename(), shared.snapshot);
+  return shared.snapshot;
+}
+
+
+
+void Simulation::seedStreams(){
+  rng.seed(run_num, 0);
+  for(unsigned int m=0;m<mts.size();m++)
+    mts[m].rng.seed(run_num, m+1);
+  surrounding_lowlands.rng.seed(run_num, mts.size()+1);
+}
+
+
+
 //This calculates the total number of living salamanders
 int Simulation::alive() const {
   int sum = 0;
@@ -189,8 +692,8 @@ double Simulation::AvgOtempdegC() const {
   int alive  = 0;
   double avg = 0;
   for(const auto &m: mts)
-  for(const auto &s: m.bin){
-    avg += s.otempdegC;
+  for(const auto &otempdegC: m.bin.otempdegC){
+    avg += otempdegC;
     alive++;
   }
 
@@ -198,6 +701,11 @@ double Simulation::AvgOtempdegC() const {
 }
 
 
+bool Simulation::rejected() const {
+  return status!="Completed" && status!="Extinct";
+}
+
+
 //Replaces the stored phylogeny (which may take up quite a bit of memory!) with
 //a new, empty phylogeny object. This causes the old phylogeny to get recycled,
 //thereby freeing the memory.
@@ -235,7 +743,7 @@ void Simulation::printMt(double tMyrs) const {
            <<std::setw(6)<<surrounding_lowlands.alive()<<"\n";
   for(unsigned int i=0;i<mts.size();i++){
     std::cout<<std::setw(2)<<i<<" "<<std::setw(5);
-    if(mts[i].heightkm()<MtBin::heightMaxKm(tMyrs))
+    if(mts[i].heightkm()<MtBin::heightMaxKm(tMyrs, params))
       std::cout<<mts[i].heightkm()<<" |"
                <<std::setw(20)<<std::string(20*mts[i].alive()/maxalive,'#')<<"| "
                <<std::setw(7)<<std::setprecision(4)
@@ -6,7 +6,11 @@
 #include "mtbin.hpp"
 #include "phylo.hpp"
 #include "params.hpp"
+#include "random.hpp"
+#include "scheduler.hpp"
+#include "environment.hpp"
 #include <stdexcept>
+#include <string>
 
 //This class will hold the parameters used to control a simulation. Running the
 //simulation will result in the creation of a phylogeny and the setting of
@@ -20,9 +24,100 @@ class Simulation {
 
   void printMt(double tMyrs) const;
 
+  //Runs the simulation. Called by runSimulation(), which catches any failure.
+  void simulate(const EnsembleScheduler *scheduler);
+
+  //Progress of the main loop. This is saved in checkpoints along with the
+  //bins, the phylogeny, and the random number streams.
+  struct Progress {
+    double tMyrs           = 0;  //Time of the last completed step
+    int    steps_in_window = 0;  //See Params::statsRecording()
+    int    steps           = 0;  //See Params::pruneMaxSteps()
+    double next_check      = 0;  //See Params::pruneCheckInterval()
+    double next_checkpoint = 0;  //See Params::checkpointInterval()
+    double seconds         = 0;  //Wall-clock time spent running so far
+    int    colour_order[3] = {0,1,2};
+    double origin          = 0;  //Time from which the timesteps are counted
+  };
+
+  //File to which this simulation's checkpoints are written. See
+  //Params::checkpointInterval().
+  std::string checkpointFilename() const;
+
+  //Saves the state of the simulation, which has made the given progress, to
+  //its checkpoint file. The file is replaced only once the new checkpoint has
+  //been written in full, so an interruption never leaves a partial one.
+  void saveCheckpoint(const Progress &progress) const;
+
+  //Restores the state and progress of the simulation from its checkpoint file.
+  //Returns false if there is no checkpoint file.
+  bool loadCheckpoint(Progress &progress);
+
+  //Writes the state of the simulation, which has made the given progress, in
+  //the format of a checkpoint
+  void writeState(std::ostream &out, const Progress &progress) const;
+
+  //Restores the state and progress of the simulation from a checkpoint. The
+  //bins must already have been made. Unless fork is true, the checkpoint must
+  //have been made by this same simulation.
+  void readState(std::istream &in, Progress &progress, bool fork);
+
+  //Seeds the random number streams of the simulation, its bins, and the
+  //lowlands from the global seed and run_num
+  void seedStreams();
+
+  //If true, the simulation stops at Params::forkTime() and leaves its state in
+  //snapshot. See ForkSnapshot().
+  bool        making_snapshot = false;
+  std::string snapshot;
+
+  //Returns why the simulation should be pruned, if it should be. See
+  //Params::pruneCheckInterval().
+  std::string pruneReason(double tMyrs, int steps, double seconds, double &next_check) const;
+
+  //Disperses salamanders between bins, and to and from the lowlands, by way of
+  //each bin's outbox. See DISPERSAL_STAGE_OUTBOX.
+  void disperseOutbox(const Environment::Step &env, int bin_threads);
+
+  //Stream from which all of this simulation's random numbers are drawn. It is
+  //derived from the global seed and run_num, so a given run produces the same
+  //results regardless of which thread runs it.
+  RandomStream rng;
+
  public:
-  //Runs the simulations described by the following properties
-  void      runSimulation();
+  //Run number of this simulation within the ensemble
+  int       run_num;
+
+  //Index of this simulation's parameter set within the sweep. See Sweep.
+  int       param_set;
+
+  //Parameters of this simulation. These must outlive the simulation.
+  const Params &params;
+
+  Simulation(int run_num, const Params &params, int param_set=0);
+
+  //If set, the simulation does not begin 65Mya but continues on from this
+  //snapshot of a shared history, made by ForkSnapshot(), drawing fresh random
+  //numbers from its own streams. The snapshot must outlive the simulation.
+  const std::string *fork_from = nullptr;
+
+  //Returns the snapshot of the shared history from which the simulations of a
+  //fork ensemble continue. See Params::forkTime(). The snapshot is read from
+  //Params::forkSnapshotFilename() if that exists; otherwise the history is
+  //simulated with the given parameters and the snapshot saved there.
+  static std::string ForkSnapshot(const Params &params);
+
+  //Runs the simulations described by the following properties. If a scheduler
+  //is given, it decides how many threads process the bins at each step. A
+  //simulation which fails does not throw; its status records the failure.
+  void      runSimulation(const EnsembleScheduler *scheduler=nullptr);
+  //How the simulation ended: "Completed" if it reached the present day,
+  //"Extinct" if every salamander died, "Pruned:<rule>" if it was stopped by one
+  //of the pruning rules (see Params::pruneCheckInterval()), or "Failed"
+  //if it failed
+  std::string status = "Completed";
+  //True if the simulation was pruned or failed, and so should be discarded
+  bool      rejected() const;
   //Number of living salamanders
   int       alive() const;
   //Returns the average optimal temperature of the living salamanders
@@ -42,7 +137,7 @@ class Simulation {
   void dumpPhylogeny();
   //Empirical cumulative distribution (ECDF) of average branch lengths between
   //extant taxa
-  double    ecdf;
+  double    ecdf = 0;
   //Time at which the simulation ended
   double    endtime = 0;
   //Average elevation of the salamanders at the end of the simulation
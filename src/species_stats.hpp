@@ -0,0 +1,98 @@
+//Summary statistics of the distribution of salamander properties are kept for
+//each species at each time step of its existence. A phylogeny holds all of its
+//species' records in a single store, with each statistic in its own array.
+//Records are appended as the simulation runs, so the arrays grow together in a
+//few large allocations rather than one small allocation per species, and all of
+//them are released at once when the phylogeny is destroyed.
+#ifndef _species_stats_hpp_
+#define _species_stats_hpp_
+
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <cstddef>
+#include "checkpoint.hpp"
+
+class SpeciesStatsStore {
+ public:
+  std::vector<int>    node;          //Species to which each record belongs
+  std::vector<double> t;             //Time at which these statistics were collected
+  std::vector<int>    num_alive;     //Number of salamanders of the species alive at that time
+  std::vector<double> elev_min;      //Minimum elevation of the species at that time
+  std::vector<double> elev_max;      //Maximum elevation of the species at that time
+  std::vector<double> elev_sum;      //Sum of the elevations of the species at that time
+  std::vector<double> opt_temp_min;  //Minimum of the optimum temperature trait at that time
+  std::vector<double> opt_temp_max;  //Maximum of the optimum temperature trait at that time
+  std::vector<double> opt_temp_sum;  //Sum of the optimum temperature trait at that time
+
+  ///Number of records in the store
+  std::size_t size() const { return node.size(); }
+
+  ///Appends an empty record for species n at time t0 and returns its index.
+  ///The record is set up so it is ready for a "reduction" pattern.
+  unsigned int add(int n, double t0){
+    node.push_back(n);
+    t.push_back(t0);
+    num_alive.push_back(0);
+    elev_min.push_back(std::numeric_limits<double>::max());
+    elev_max.push_back(std::numeric_limits<double>::min());
+    elev_sum.push_back(0);
+    opt_temp_min.push_back(std::numeric_limits<double>::max());
+    opt_temp_max.push_back(std::numeric_limits<double>::min());
+    opt_temp_sum.push_back(0);
+    return node.size()-1;
+  }
+
+  ///Adds a salamander to record r
+  void update(unsigned int r, double elevation, double opt_temp){
+    num_alive[r]++;
+    elev_min[r]      = std::min(elev_min[r],elevation);
+    elev_max[r]      = std::max(elev_max[r],elevation);
+    elev_sum[r]     += elevation;
+    opt_temp_min[r]  = std::min(opt_temp_min[r],opt_temp);
+    opt_temp_max[r]  = std::max(opt_temp_max[r],opt_temp);
+    opt_temp_sum[r] += opt_temp;
+  }
+
+  ///Returns the indices of the records ordered by species. Each species'
+  ///records keep the order in which they were added, which is time order.
+  std::vector<unsigned int> bySpecies(unsigned int num_species) const {
+    std::vector<unsigned int> start(num_species+1,0);
+    for(const auto n: node)
+      start[n+1]++;
+    for(unsigned int n=0;n<num_species;n++)
+      start[n+1] += start[n];
+    std::vector<unsigned int> order(size());
+    for(unsigned int r=0;r<size();r++)
+      order[start[node[r]]++] = r;
+    return order;
+  }
+
+  ///Writes the store to a checkpoint. See checkpoint.hpp.
+  void save(std::ostream &out) const {
+    WriteBinary(out, node);
+    WriteBinary(out, t);
+    WriteBinary(out, num_alive);
+    WriteBinary(out, elev_min);
+    WriteBinary(out, elev_max);
+    WriteBinary(out, elev_sum);
+    WriteBinary(out, opt_temp_min);
+    WriteBinary(out, opt_temp_max);
+    WriteBinary(out, opt_temp_sum);
+  }
+
+  ///Replaces the store with one written by save()
+  void load(std::istream &in){
+    ReadBinary(in, node);
+    ReadBinary(in, t);
+    ReadBinary(in, num_alive);
+    ReadBinary(in, elev_min);
+    ReadBinary(in, elev_max);
+    ReadBinary(in, elev_sum);
+    ReadBinary(in, opt_temp_min);
+    ReadBinary(in, opt_temp_max);
+    ReadBinary(in, opt_temp_sum);
+  }
+};
+
+#endif
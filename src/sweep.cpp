@@ -0,0 +1,179 @@
+#include "sweep.hpp"
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <stdexcept>
+#include <random>
+#include <utility>
+
+Sweep::Sweep(const Params &base){
+  sets.push_back(base);
+  values.push_back(std::vector<double>());
+}
+
+
+//Every combination of the listed values. The last parameter varies fastest.
+static void SweepGrid(
+  std::vector<std::string> &lines,
+  std::vector<std::string> &names,
+  std::vector< std::vector<double> > &values
+){
+  std::vector< std::vector<double> > levels;
+  for(const auto &line: lines){
+    std::istringstream ss(line);
+    std::string name;
+    ss>>name;
+    std::vector<double> these;
+    double v;
+    while(ss>>v)
+      these.push_back(v);
+    if(these.empty()){
+      std::cerr<<"No values given for sweep parameter '"<<name<<"'!"<<std::endl;
+      throw std::runtime_error("No values given for sweep parameter!");
+    }
+    names.push_back(name);
+    levels.push_back(these);
+  }
+
+  std::size_t nsets = 1;
+  for(const auto &l: levels)
+    nsets *= l.size();
+
+  for(std::size_t s=0;s<nsets;s++){
+    std::vector<double> set(levels.size());
+    std::size_t rest = s;
+    for(int k=(int)levels.size()-1;k>=0;k--){
+      set[k] = levels[k][rest%levels[k].size()];
+      rest  /= levels[k].size();
+    }
+    values.push_back(set);
+  }
+}
+
+
+//Latin hypercube sampling: each parameter's range is split into n equal strata
+//and each stratum is used by exactly one set, with the strata of the different
+//parameters paired at random. The draws come from their own generator so that
+//the sets depend only on the sweep file.
+static void SweepLatinHypercube(
+  std::vector<std::string> &lines,
+  std::vector<std::string> &names,
+  std::vector< std::vector<double> > &values
+){
+  int           nsamples = 0;
+  unsigned long seed     = 0;
+  std::vector<double> lo, hi;
+  for(const auto &line: lines){
+    std::istringstream ss(line);
+    std::string name;
+    ss>>name;
+    if(name=="Samples"){
+      ss>>nsamples;
+    } else if(name=="Seed"){
+      ss>>seed;
+    } else {
+      double a, b;
+      if(!(ss>>a>>b)){
+        std::cerr<<"Expected a minimum and maximum for sweep parameter '"<<name<<"'!"<<std::endl;
+        throw std::runtime_error("Expected a minimum and maximum for sweep parameter!");
+      }
+      names.push_back(name);
+      lo.push_back(a);
+      hi.push_back(b);
+    }
+  }
+  if(nsamples<1){
+    std::cerr<<"LatinHypercube sweeps need Samples of at least 1!"<<std::endl;
+    throw std::runtime_error("LatinHypercube sweeps need Samples of at least 1!");
+  }
+
+  std::mt19937_64 gen(seed);
+  auto uniform = [&](){ return (gen()>>11)/9007199254740992.0; }; //[0,1)
+
+  values.assign(nsamples, std::vector<double>(names.size()));
+  for(unsigned int k=0;k<names.size();k++){
+    std::vector<int> strata(nsamples);
+    for(int i=0;i<nsamples;i++)
+      strata[i] = i;
+    for(int i=nsamples-1;i>0;i--)
+      std::swap(strata[i], strata[gen()%(i+1)]);
+    for(int s=0;s<nsamples;s++)
+      values[s][k] = lo[k]+(strata[s]+uniform())/nsamples*(hi[k]-lo[k]);
+  }
+}
+
+
+//The first line names the parameters and each following line is a set
+static void SweepList(
+  std::vector<std::string> &lines,
+  std::vector<std::string> &names,
+  std::vector< std::vector<double> > &values
+){
+  if(lines.empty())
+    return;
+  {
+    std::istringstream ss(lines[0]);
+    std::string name;
+    while(ss>>name)
+      names.push_back(name);
+  }
+  for(unsigned int l=1;l<lines.size();l++){
+    std::istringstream ss(lines[l]);
+    std::vector<double> set;
+    double v;
+    while(ss>>v)
+      set.push_back(v);
+    if(set.size()!=names.size()){
+      std::cerr<<"Sweep list line '"<<lines[l]<<"' should have "<<names.size()<<" values!"<<std::endl;
+      throw std::runtime_error("Sweep list line has the wrong number of values!");
+    }
+    values.push_back(set);
+  }
+}
+
+
+void Sweep::load(const std::string &filename, const Params &base){
+  std::ifstream fin(filename);
+  if(!fin.good()){
+    std::cerr<<"Could not open sweep file '"<<filename<<"'!"<<std::endl;
+    throw std::runtime_error("Could not open sweep file!");
+  }
+
+  std::string kind;
+  fin>>kind;
+
+  std::vector<std::string> lines;
+  std::string line;
+  while(std::getline(fin,line))
+    if(line.find_first_not_of(" \t\r")!=std::string::npos)
+      lines.push_back(line);
+
+  names.clear();
+  values.clear();
+  sets.clear();
+
+  if(kind=="Grid")
+    SweepGrid(lines, names, values);
+  else if(kind=="LatinHypercube")
+    SweepLatinHypercube(lines, names, values);
+  else if(kind=="List")
+    SweepList(lines, names, values);
+  else {
+    std::cerr<<"Unrecognised sweep type! Expected: Grid, LatinHypercube, List"<<std::endl;
+    throw std::runtime_error("Unrecognised sweep type! Expected: Grid, LatinHypercube, List");
+  }
+
+  if(values.empty()){
+    std::cerr<<"Sweep file '"<<filename<<"' contains no parameter sets!"<<std::endl;
+    throw std::runtime_error("Sweep file contains no parameter sets!");
+  }
+
+  //Integer parameters are rounded when set, so the values are updated to those
+  //actually used
+  for(auto &set: values){
+    Params p = base;
+    for(unsigned int k=0;k<names.size();k++)
+      set[k] = p.set(names[k], set[k]);
+    sets.push_back(p);
+  }
+}
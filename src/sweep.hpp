@@ -0,0 +1,44 @@
+#ifndef _sweep_hpp_
+#define _sweep_hpp_
+
+#include "params.hpp"
+#include <string>
+#include <vector>
+
+//A Sweep is the list of parameter sets an ensemble is run over. Each set is
+//the base parameters with some of the numeric parameters (see Params::set())
+//changed. Every set is run maxiter times, all within the one process.
+//
+//A sweep file begins with the kind of sweep, followed by lines describing the
+//parameters to vary:
+//
+//  Grid                      Every combination of the listed values
+//  <Param> <v1> <v2> ...
+//
+//  LatinHypercube            Samples sets drawn from the given ranges so that
+//  Samples <n>               each range is divided into n strata, each of
+//  Seed    <s>               which is sampled once
+//  <Param> <min> <max>
+//
+//  List                      Each following line is a set
+//  <Param1> <Param2> ...
+//  <v1>     <v2>     ...
+class Sweep {
+ public:
+  //A sweep made up of the single set base
+  Sweep(const Params &base);
+
+  //Reads the sweep file filename and builds its sets from base
+  void load(const std::string &filename, const Params &base);
+
+  //Names of the parameters which differ between the sets
+  std::vector<std::string> names;
+
+  //values[s][k] is the value of parameter names[k] in set s
+  std::vector< std::vector<double> > values;
+
+  //The parameter sets
+  std::vector<Params> sets;
+};
+
+#endif
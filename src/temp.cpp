@@ -1,32 +1,100 @@
 //Define a singleton class for Temperatures
 
 #include "temp.hpp"
+#include "timeline.hpp"
 #include <fstream>
 #include <iostream>
 #include <cassert>
 #include <algorithm>
 #include <string>
+#include <cstring>
+#include <cstdio>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+///Header of a binary temperature file. See temp.hpp.
+struct TemperatureFileHeader {
+  char          magic[8];
+  std::uint32_t version;
+  std::uint32_t header_bytes;
+  std::uint64_t count;
+  double        samples_per_myr;
+  double        start_myrs;
+  double        span_myrs;
+};
+static_assert(sizeof(TemperatureFileHeader)%sizeof(double)==0, "Temperatures must follow the header aligned");
+
+///Resolution of text temperature files
+static const double TEXT_SAMPLES_PER_MYR = 1000;
+
 
 TemperatureClass::TemperatureClass(){
-  test = false;
+  series          = nullptr;
+  last            = 0;
+  samples_per_myr = 0;
+  start_myrs      = 0;
+  mapping         = nullptr;
+  mapping_bytes   = 0;
+  test            = false;
+}
+
+
+TemperatureClass::~TemperatureClass(){
+  if(mapping)
+    munmap(mapping, mapping_bytes);
+}
+
+
+bool TemperatureFileIsBinary(const std::string &filename){
+  std::ifstream fin(filename, std::ios::binary);
+  char magic[sizeof(TEMPERATURE_FILE_MAGIC)];
+  fin.read(magic, sizeof(magic));
+  return fin && std::equal(magic, magic+sizeof(magic), TEMPERATURE_FILE_MAGIC);
 }
 
 
 //Use the RAII pattern. Load a file and read in the temperature data.
 void TemperatureClass::init(const std::string filename) {
-  assert(temps.size()==0);
+  if(series){
+    std::cerr<<"Temperatures have already been loaded!"<<std::endl;
+    throw std::runtime_error("Temperatures have already been loaded!");
+  }
+
+  if(TemperatureFileIsBinary(filename))
+    initBinary(filename);
+  else
+    initText(filename);
+
+  //Every simulation runs from 0 to 65 million years
+  const double span = last/samples_per_myr;
+  if(start_myrs>0 || !TimeReached(start_myrs+span, 65)){
+    std::cerr<<"Temperature series '"<<filename<<"' covers "<<start_myrs<<" to "
+             <<(start_myrs+span)<<" Myr, but must cover 0 to 65 Myr!"<<std::endl;
+    throw std::runtime_error("Temperature series does not cover 0 to 65 Myr!");
+  }
+}
 
+
+void TemperatureClass::initText(const std::string &filename){
   //Read in temperatures
   std::ifstream fin(filename);
   if(!fin.good()){
     std::cerr<<"Could not open temperature file '"<<filename<<"'!"<<std::endl;
-    assert(fin.good());
+    throw std::runtime_error("Could not open temperature file!");
   }
 
   double temp;                              //Temporary variable for reading
   while(fin>>temp)                          //Read data, if available
     temps.push_back(temp);                  //Put in back of series
 
+  if(temps.empty()){
+    std::cerr<<"Temperature file '"<<filename<<"' contains no temperatures!"<<std::endl;
+    throw std::runtime_error("Temperature file contains no temperatures!");
+  }
+
   //The data file we used needs to be reversed (if it is read in the above
   //manner) in order to be in chronological order.
   std::reverse(temps.begin(),temps.end());
@@ -34,52 +102,123 @@ void TemperatureClass::init(const std::string filename) {
   //Copy the last value of the array to ensure that we can interpolate right up
   //to the end of the time series
   temps.push_back(temps.back());
+
+  series          = temps.data();
+  last            = temps.size()-2;
+  samples_per_myr = TEXT_SAMPLES_PER_MYR;
+  start_myrs      = 0;
 }
 
 
-//Get the temperature at tMyrs, interpolating if necessary.
-double TemperatureClass::getTemp(double tMyrs) const {
-  //Ensure that we've read temperature data
-  assert(temps.size()!=0);
+//The file is mapped read-only and shared, so every process which maps it uses
+//the same pages of memory
+void TemperatureClass::initBinary(const std::string &filename){
+  const int fd = open(filename.c_str(), O_RDONLY);
+  struct stat st;
+  if(fd<0 || fstat(fd, &st)!=0){
+    if(fd>=0)
+      close(fd);
+    std::cerr<<"Could not open temperature file '"<<filename<<"'!"<<std::endl;
+    throw std::runtime_error("Could not open temperature file!");
+  }
 
-  //If we are in testing mode, return the temperature the user wanted to test
-  //with.
-  if(test) return testTemp;
+  mapping_bytes = st.st_size;
+  mapping       = mmap(nullptr, mapping_bytes, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if(mapping==MAP_FAILED){
+    mapping = nullptr;
+    std::cerr<<"Could not map temperature file '"<<filename<<"'!"<<std::endl;
+    throw std::runtime_error("Could not map temperature file!");
+  }
 
-  double timeKyrs = tMyrs*1000;
+  TemperatureFileHeader header;
+  bool good = mapping_bytes>=sizeof(header);
+  if(good){
+    std::memcpy(&header, mapping, sizeof(header));
+    good = header.version==TEMPERATURE_FILE_VERSION
+        && header.header_bytes>=sizeof(header)
+        && header.header_bytes%sizeof(double)==0
+        && header.count>=1
+        && header.samples_per_myr>0
+        && mapping_bytes==header.header_bytes+(header.count+1)*sizeof(double);
+  }
+  if(!good){
+    std::cerr<<"Temperature file '"<<filename<<"' is malformed or of an unsupported version!"<<std::endl;
+    throw std::runtime_error("Malformed temperature file!");
+  }
 
-  //Assumes that time is always positive
-  unsigned int t0 = (unsigned int)timeKyrs; //Time of the start of the 1kyr bin
+  series          = reinterpret_cast<const double*>(static_cast<const char*>(mapping)+header.header_bytes);
+  last            = header.count-1;
+  samples_per_myr = header.samples_per_myr;
+  start_myrs      = header.start_myrs;
+}
 
-  //Ensure that we have points to interpolate with
-  assert(t0 >= 0);
 
-  //temps.size() is 1 larger than the position of the last element of the array.
-  //temps.size()-1 is that last element. But we have copied the last element so
-  //that there are two instances of it. This means that temps.size()-2 is the
-  //last temperature period for which we can perform an interpolation.
-  assert(t0 <= temps.size()-2);
+void TemperatureClass::save(const std::string &filename) const {
+  TemperatureFileHeader header;
+  std::copy(TEMPERATURE_FILE_MAGIC, TEMPERATURE_FILE_MAGIC+sizeof(header.magic), header.magic);
+  header.version         = TEMPERATURE_FILE_VERSION;
+  header.header_bytes    = sizeof(header);
+  header.count           = last+1;
+  header.samples_per_myr = samples_per_myr;
+  header.start_myrs      = start_myrs;
+  header.span_myrs       = last/samples_per_myr;
+
+  std::ofstream fout(filename, std::ios::binary);
+  fout.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  fout.write(reinterpret_cast<const char*>(series), (last+2)*sizeof(double));
+  fout.close();
+  if(fout.fail()){
+    std::cerr<<"Could not write temperature file '"<<filename<<"'!"<<std::endl;
+    throw std::runtime_error("Could not write temperature file!");
+  }
+}
+
+
+//Get the temperature at tMyrs, interpolating if necessary. The series is
+//padded with a copy of its last temperature, so no check is needed to
+//interpolate at its very end; times past the end are clamped to it.
+double TemperatureClass::getTemp(double tMyrs) const {
+  const double      x  = (tMyrs-start_myrs)*samples_per_myr;
+  const std::size_t t0 = std::min((std::size_t)x, last); //Start of the sample interval
 
   //The following performs the interpolation
-  double ta    = temps[t0];        //Temperature of this 1kyr bin
-  double tb    = temps[t0+1];      //Temperature of the next 1kyr bin
-  double tdiff = tb-ta;            //Temperature difference between the two bins
-  return ta + tdiff*(timeKyrs-t0); //Perform the interpolation
+  double ta    = series[t0];       //Temperature at the start of the interval
+  double tb    = series[t0+1];     //Temperature at the end of the interval
+  double tdiff = tb-ta;            //Temperature difference across the interval
+  return ta + tdiff*(x-t0);        //Perform the interpolation
 }
 
 
 //Turn testing mode on
 void TemperatureClass::testOn(double temp){
-  test     = true;
-  testTemp = temp;
-  //std::cerr<<"Temperature test mode on. Temp set to "<<testTemp<<"degC"<<std::endl;
+  if(!test){
+    saved_series          = series;
+    saved_last            = last;
+    saved_samples_per_myr = samples_per_myr;
+    saved_start_myrs      = start_myrs;
+  }
+  test            = true;
+  test_series[0]  = temp;
+  test_series[1]  = temp;
+  series          = test_series;
+  last            = 0;
+  samples_per_myr = 0;
+  start_myrs      = 0;
+  //std::cerr<<"Temperature test mode on. Temp set to "<<temp<<"degC"<<std::endl;
 }
 
 
 //Turn testing mode off
 void TemperatureClass::testOff(){
+  if(test){
+    series          = saved_series;
+    last            = saved_last;
+    samples_per_myr = saved_samples_per_myr;
+    start_myrs      = saved_start_myrs;
+  }
   test = false;
   std::cerr<<"Temperature test mode off."<<std::endl;
 }
 
-TemperatureClass Temperature;
\ No newline at end of file
+TemperatureClass Temperature;
@@ -3,42 +3,100 @@
 
 #include <vector>
 #include <string>
+#include <cstddef>
+#include <cstdint>
 
 //Define a singleton class for Temperatures which loads them, stores them, and
 //interpolates between them as necessary.
+//
+//The series may be read from a text file, with one temperature per line from
+//the present back to 65Mya, or from a binary file written by save() (see
+//tempconvert.cpp). A binary file is mapped into memory rather than read, so
+//loading it is nearly instant and the processes of a sweep share one copy of
+//it. A binary file begins with a header:
+//
+//  char     magic[8]          "SALTEMP\0"
+//  uint32   version           TEMPERATURE_FILE_VERSION
+//  uint32   header_bytes      Size of the header; the temperatures follow it
+//  uint64   count             Number of temperatures in the series
+//  double   samples_per_myr   Resolution of the series
+//  double   start_myrs        Time of the first temperature
+//  double   span_myrs         Time between the first and last temperatures
+//
+//followed by count+1 doubles in chronological order. The last repeats the one
+//before it so that the series can be interpolated right up to its end. Values
+//are in the machine's native byte order.
 class TemperatureClass {
  private:
-  //The temperature series
+  ///The temperature series, if it was read from a text file
   std::vector<double> temps;
 
-  ///If this is TRUE then any calls to getTemp() return testTemp instead. This
-  ///is FALSE by default.s
-  bool test;
+  ///The series in use: count+1 temperatures, of which the last is a copy of
+  ///the one before. Points into temps, the mapped file, or test_series.
+  const double *series;
 
-  ///testTemp is the value to return from getTemp() if test is TRUE
-  double testTemp;
+  ///Index of the last temperature from which getTemp() interpolates
+  std::size_t   last;
+
+  ///Resolution of the series and time of its first temperature
+  double        samples_per_myr;
+  double        start_myrs;
+
+  ///The mapped binary file, if there is one
+  void         *mapping;
+  std::size_t   mapping_bytes;
+
+  ///While in test mode, the series is replaced by a constant one with a
+  ///resolution of zero, so getTemp() returns the test temperature without
+  ///needing to check for test mode. The real series is kept here meanwhile.
+  double        test_series[2];
+  const double *saved_series;
+  std::size_t   saved_last;
+  double        saved_samples_per_myr;
+  double        saved_start_myrs;
+  bool          test;
+
+  ///Loads a text file
+  void initText(const std::string &filename);
+
+  ///Maps a binary file
+  void initBinary(const std::string &filename);
 
   //The following ensure that this class is a singleton
   TemperatureClass(const TemperatureClass&);             ///Prevent copying
   TemperatureClass& operator=(const TemperatureClass&);  ///Prevent assignment
  public:
   TemperatureClass();
+  ~TemperatureClass();
 
-  ///Load temperature data from the filename
+  ///Load temperature data from the filename, which may be a text or binary
+  ///file. The series must cover 0 to 65 million years.
   void init(const std::string filename);
 
+  ///Writes the series to filename in the binary format
+  void save(const std::string &filename) const;
+
   ///Get temperature at tMyrs performing interpolation if necessary. If test
   ///mode is on, then the actual temperature data is ignored and testTemp is
-  ///returned.
+  ///returned. Times past the end of the series are given its last temperature.
   double getTemp(double tMyrs) const;
 
   ///Turn test mode on. If test mode is on, then calls to getTemp() return temp.
   void testOn(double temp);
-  
+
   ///Turn test mode off.
   void testOff();
 };
 
+///Identifies a binary temperature file
+const char TEMPERATURE_FILE_MAGIC[8] = {'S','A','L','T','E','M','P','\0'};
+
+///Incremented whenever the binary temperature format changes
+const std::uint32_t TEMPERATURE_FILE_VERSION = 1;
+
+///Returns true if filename is a binary temperature file
+bool TemperatureFileIsBinary(const std::string &filename);
+
 extern TemperatureClass Temperature;
 
-#endif
\ No newline at end of file
+#endif
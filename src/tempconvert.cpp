@@ -0,0 +1,32 @@
+//Converts a text temperature series into the binary format, which is mapped
+//into memory rather than parsed and so loads almost instantly. Build with
+//`make tempconvert` and run:
+//
+//  ./tempconvert.exe <Text Temperature File> <Binary Temperature File>
+//
+//The binary file may then be given as the TempSeries parameter. See temp.hpp.
+#include "temp.hpp"
+#include <iostream>
+#include <stdexcept>
+using namespace std;
+
+int main(int argc, char **argv){
+  if(argc!=3){
+    cout<<"Syntax: "<<argv[0]<<" <Text Temperature File> <Binary Temperature File>\n";
+    return -1;
+  }
+
+  Temperature.init(argv[1]);
+  Temperature.save(argv[2]);
+
+  //Check that the binary file reproduces the text file exactly
+  TemperatureClass check;
+  check.init(argv[2]);
+  for(double tMyrs=0;tMyrs<65.0001;tMyrs+=0.0005)
+    if(check.getTemp(tMyrs)!=Temperature.getTemp(tMyrs)){
+      cerr<<"The binary file differs from the text file at "<<tMyrs<<" Myr!"<<endl;
+      return -1;
+    }
+
+  return 0;
+}
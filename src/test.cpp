@@ -4,6 +4,8 @@
 #include "simulation.hpp"
 #include "temp.hpp"
 #include "random.hpp"
+#include "mortality.hpp"
+#include "timeline.hpp"
 #include <array>
 #include <vector>
 #include <iostream>
@@ -12,6 +14,10 @@
 #include <iomanip>
 #include <string>
 #include <bitset>
+#include <cmath>
+#include <algorithm>
+#include <numeric>
+#include <sstream>
 using namespace std;
 
 int main(int argc, char **argv){
@@ -42,7 +48,156 @@ int main(int argc, char **argv){
   cout<<"Maximum height over time: \n";
   for(double tMyrs;tMyrs<65.001;tMyrs+=0.5)
     cout<<"Maximum elevation at "
-        <<setw(4)<<tMyrs<<"\t=\t"<<MtBin::heightMaxKm(tMyrs)<<endl;
+        <<setw(4)<<tMyrs<<"\t=\t"<<MtBin::heightMaxKm(tMyrs, TheParams)<<endl;
+
+  {
+    double maxerr = 0;
+    for(double x=-40;x<=40;x+=1e-4)
+      maxerr = std::max(maxerr, std::abs(FastSigmoid(x)-1/(1+std::exp(-x))));
+    cout<<"Maximum FastSigmoid error on [-40,40]: "<<maxerr
+        <<" (bound "<<FAST_SIGMOID_MAX_ERROR<<") "
+        <<(maxerr<=FAST_SIGMOID_MAX_ERROR?"OK":"FAILED")<<endl;
+  }
+
+  {
+    //Each salamander should be chosen to disperse with probability p
+    MtBin m(0, TheParams);
+    for(int i=0;i<1000;i++)
+      m.addSalamander(Salamander());
+    std::vector<unsigned int> candidates;
+    std::vector<int> chosen(1000,0);
+    const double p = 0.05;
+    const int trials = 20000;
+    for(int t=0;t<trials;t++){
+      m.dispersalCandidates(p, candidates);
+      for(auto c: candidates)
+        chosen[c]++;
+    }
+    int minchosen = *std::min_element(chosen.begin(),chosen.end());
+    int maxchosen = *std::max_element(chosen.begin(),chosen.end());
+    double total  = std::accumulate(chosen.begin(),chosen.end(),0.0);
+    cout<<"Dispersal candidates per trial: "<<(total/trials)
+        <<" (expected "<<(1000*p)<<"), per-salamander range ["
+        <<minchosen<<","<<maxchosen<<"] (expected ~"<<(trials*p)<<")"<<endl;
+  }
+
+  {
+    //Each gene should flip with probability MutationProb
+    const int trials = 100000;
+    std::vector<int> flips(Salamander::genetype().size(),0);
+    for(int t=0;t<trials;t++){
+      Salamander s;
+      s.mutate(TheParams.mutationProb());
+      for(unsigned int b=0;b<s.genes.size();b++)
+        flips[b] += s.genes[b];
+    }
+    double total = std::accumulate(flips.begin(),flips.end(),0.0);
+    cout<<"Mutations per genome: "<<(total/trials)<<" (expected "
+        <<(flips.size()*TheParams.mutationProb())<<"), per-gene range ["
+        <<*std::min_element(flips.begin(),flips.end())<<","
+        <<*std::max_element(flips.begin(),flips.end())<<"] (expected ~"
+        <<(trials*TheParams.mutationProb())<<")"<<endl;
+  }
+
+  {
+    //Outbox dispersal should neither create nor destroy salamanders, and each
+    //salamander should move at most one bin
+    std::vector<MtBin> mts;
+    for(int m=0;m<3;m++){
+      mts.push_back(MtBin(m*0.1, TheParams));
+      for(int i=0;i<1000;i++){
+        Salamander s;
+        s.species = m*1000+i;
+        mts.back().addSalamander(s);
+      }
+    }
+    const Environment env({0, 0.1, 0.2}, TheParams, 65);
+    for(unsigned int m=0;m<mts.size();m++)
+      mts[m].emigrateLocal(env.at(65), mts, m);
+    for(unsigned int d=0;d<mts.size();d++)
+    for(unsigned int m=0;m<mts.size();m++)
+      mts[d].immigrateFrom(mts[m], d);
+    unsigned int total = 0;
+    bool one_bin = true;
+    for(unsigned int m=0;m<mts.size();m++){
+      total += mts[m].alive();
+      for(auto sp: mts[m].bin.species)
+        one_bin &= std::abs(sp/1000-(int)m)<=1;
+    }
+    cout<<"Outbox dispersal: "<<total<<" salamanders after dispersal (expected 3000), "
+        <<"moved at most one bin: "<<(one_bin?"OK":"FAILED")<<endl;
+  }
+
+  {
+    //The environment table should hold what the bins would compute. With
+    //-ffast-math the compiler may round them differently when they are
+    //inlined here, so they need only agree to within rounding.
+    auto close = [](double a, double b){ return std::abs(a-b)<=1e-12*std::max(1.0,std::abs(b)); };
+    std::vector<double> heights;
+    std::vector<MtBin>  bins;
+    for(int m=0;m<TheParams.numBins();m++){
+      heights.push_back(m*2.8/TheParams.numBins());
+      bins.push_back(MtBin(heights.back(), TheParams));
+    }
+    const Environment env(heights, TheParams, 0);
+    bool same = true;
+    int  steps = 0;
+    for(double tMyrs=0;BeforeEndOfTime(tMyrs);tMyrs+=TheParams.timestep(),steps++){
+      const Environment::Step e = env.at(tMyrs);
+      same &= close(e.max_height, MtBin::heightMaxKm(tMyrs, TheParams));
+      for(unsigned int m=0;m<bins.size();m++)
+        same &= close(e.temp[m], bins[m].temp(tMyrs))
+             && close(e.area[m], bins[m].area(bins[m].heightkm(), tMyrs))
+             && (bool)e.above_summit[m]==(bins[m].heightkm()>=e.max_height);
+    }
+    cout<<"Environment table over "<<steps<<" timesteps: "<<(same?"OK":"FAILED")<<endl;
+  }
+
+  {
+    //A bin restored from a checkpoint should hold the same salamanders and go
+    //on to draw the same random numbers, including a cached normal value
+    MtBin a(0.5, TheParams);
+    a.rng.seed(1, 2);
+    for(int i=0;i<100;i++){
+      Salamander s;
+      s.species   = i;
+      s.otempdegC = i*0.25;
+      a.addSalamander(s);
+    }
+    a.rng.normal(a.rng.engine);
+    std::stringstream ss;
+    a.save(ss);
+    MtBin b(0, TheParams);
+    b.load(ss);
+    bool same = b.heightkm()==a.heightkm() && b.bin.species==a.bin.species && b.bin.otempdegC==a.bin.otempdegC;
+    for(int i=0;i<10;i++)
+      same &= a.rng.normal(a.rng.engine)==b.rng.normal(b.rng.engine) && a.rng.engine()==b.rng.engine();
+    cout<<"Checkpointed bin round trip: "<<(same?"OK":"FAILED")<<endl;
+  }
+
+  {
+    //Newick trees should be written as the original recursive writer wrote
+    //them, including the unlabelled tree of Eve alone
+    Salamander eve;
+    eve.species = 0;
+    Phylogeny alone(eve, 0);
+    std::ostringstream a;
+    alone.writeNewick(a, 0, false);
+
+    Phylogeny pair(eve, 0);
+    Salamander child;
+    child.species = 0;
+    pair.nodes.push_back(PhyloNode(child, 1));
+    pair.nodes[1].older_sibling = pair.nodes[0].newest_child;
+    pair.nodes[0].newest_child  = 1;
+    pair.nodes[0].lastchild = 2;
+    pair.nodes[1].lastchild = 3;
+    std::ostringstream b;
+    pair.writeNewick(b, 3, false);
+
+    const bool same = a.str()==":0.000000;" && b.str()=="(S0:1.000000,S1:2.000000):0.000000;";
+    cout<<"Newick trees "<<a.str()<<" "<<b.str()<<": "<<(same?"OK":"FAILED")<<endl;
+  }
 
   cout<<"10000 random uint64 bit fields: ";
   for(int i=0;i<10000;i++)
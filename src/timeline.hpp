@@ -0,0 +1,27 @@
+//Simulations advance time by adding the timestep to a running total, starting
+//from 0 (65Mya), so the time of each step carries a little floating-point
+//error: at a timestep of 0.1 the step meant to fall at 65 falls at
+//65.00000000000058. Times are therefore never compared exactly. The functions
+//here make the comparisons, allowing a tolerance far larger than the error but
+//far smaller than any timestep.
+#ifndef _timeline_hpp_
+#define _timeline_hpp_
+
+///The main loop runs while the time is less than this. The extra thousandth of
+///a million years ensures that the step at 65 is taken.
+const double END_OF_TIME_MYRS = 65.001;
+
+///Tolerance for comparing the time of a step with a given time
+const double TIME_TOLERANCE_MYRS = 1e-9;
+
+///Returns true if the step at time tMyrs is at or after time x
+inline bool TimeReached(double tMyrs, double x){
+  return x-TIME_TOLERANCE_MYRS<=tMyrs;
+}
+
+///Returns true if the main loop takes a step at time tMyrs
+inline bool BeforeEndOfTime(double tMyrs){
+  return tMyrs<END_OF_TIME_MYRS;
+}
+
+#endif
@@ -0,0 +1,158 @@
+#include "writer.hpp"
+#include "params.hpp"
+#include <iostream>
+#include <stdexcept>
+
+std::string SimulationSummaryHeader(const Sweep &sweep) {
+  std::string header = "RunNum, MutationProb, TempDriftSD, SimThresh, Nspecies, ECDF, "
+                       "AvgOtempdegC, Nalive, EndTime, AvgElevation, Status, ParamSet";
+  for(const auto &name: sweep.names)
+    header += ", "+name;
+  return header;
+}
+
+void printSimulationSummary(std::ostream &out, int r, const Simulation &sim, const Sweep &sweep){
+  out<<r;
+  out<<", " << sim.params.mutationProb();
+  out<<", " << sim.params.tempDrift();
+  out<<", " << sim.params.speciesSimthresh();
+  out<<", " << sim.nspecies;
+  out<<", " << sim.ecdf;
+  out<<", " << sim.avg_otempdegC;
+  out<<", " << sim.salive;
+  out<<", " << sim.endtime;
+  out<<", " << sim.avg_elevation;
+  out<<", " << sim.status;
+  out<<", " << sim.param_set;
+  for(const auto v: sweep.values.at(sim.param_set))
+    out<<", " << v;
+  out<<std::endl;
+}
+
+
+
+ResultWriter::ResultWriter(int capacity, const Sweep &sweep) :
+  f_summary      (TheParams.outSummaryFilename()),
+  f_persist      (TheParams.outPersistFilename()),
+  f_phylogeny    (TheParams.outPhylogenyFilename()),
+  f_species_stats(TheParams.outSpeciesStatsFilename()),
+  sweep          (sweep)
+{
+  this->capacity = capacity;
+  f_summary<<SimulationSummaryHeader(sweep)<<std::endl;
+  thread = std::thread(&ResultWriter::writeLoop, this);
+}
+
+
+ResultWriter::~ResultWriter(){
+  if(!thread.joinable())
+    return;
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    finishing = true;
+  }
+  submitted.notify_all();
+  thread.join();
+}
+
+
+void ResultWriter::submit(std::unique_ptr<Simulation> sim){
+  std::unique_lock<std::mutex> lock(mtx);
+  const int r = sim->run_num;
+  //Since each thread of the ensemble takes the next unstarted run, the run
+  //numbered next_run is always either waiting here or still running, so this
+  //cannot wait forever. If writing has failed, nothing more will be written.
+  written.wait(lock, [&]{ return r<next_run+capacity || error; });
+  if(error)
+    return;
+  pending[r] = std::move(sim);
+  lock.unlock();
+  submitted.notify_all();
+}
+
+
+void ResultWriter::finish(){
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    finishing = true;
+  }
+  submitted.notify_all();
+  thread.join();
+
+  f_summary.close();
+  f_persist.close();
+  f_phylogeny.close();
+  f_species_stats.close();
+
+  if(error)
+    std::rethrow_exception(error);
+}
+
+
+double ResultWriter::ioTime(){
+  return timer_io.accumulated();
+}
+
+
+//Writes the simulations in order of run number. Once no more are coming, any
+//left over are written in order even if a run number is missing.
+void ResultWriter::writeLoop(){
+  std::unique_lock<std::mutex> lock(mtx);
+  while(true){
+    submitted.wait(lock, [&]{
+      return finishing || (!pending.empty() && pending.begin()->first==next_run);
+    });
+    if(pending.empty())
+      return;
+
+    std::unique_ptr<Simulation> sim = std::move(pending.begin()->second);
+    const int r = pending.begin()->first;
+    pending.erase(pending.begin());
+    lock.unlock();
+
+    std::exception_ptr write_error;
+    timer_io.start();
+    try {
+      write(*sim);
+    } catch (...) {
+      write_error = std::current_exception();
+    }
+    timer_io.stop();
+    //Free the simulation before accepting more
+    sim.reset();
+
+    lock.lock();
+    next_run = r+1;
+    if(write_error){
+      error = write_error;
+      pending.clear();
+    }
+    written.notify_all();
+    if(error)
+      return;
+  }
+}
+
+
+void ResultWriter::write(const Simulation &sim){
+  const int r = sim.run_num;
+
+  //Summary statistics of the run
+  printSimulationSummary(f_summary, r, sim, sweep);
+
+  //Persistence table
+  sim.phylos.persistGraph(r, f_persist);
+
+  //Phylogeny
+  f_phylogeny<<r<<" ";
+  sim.phylos.writeNewick(f_phylogeny, sim.endtime, sim.params.newickExtantOnly());
+  f_phylogeny<<'\n';
+
+  //Summaries of the distribution of species properties at each point in time
+  sim.phylos.speciesSummaries(r, f_species_stats);
+
+  if(!f_summary || !f_persist || !f_phylogeny || !f_species_stats){
+    std::cerr<<"Failed to write the results of run "<<r<<"!"<<std::endl;
+    throw std::runtime_error("Failed to write results.");
+  }
+}
@@ -0,0 +1,96 @@
+#ifndef _writer_hpp_
+#define _writer_hpp_
+
+#include "simulation.hpp"
+#include "sweep.hpp"
+#include "timer.hpp"
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <exception>
+#include <string>
+
+//ResultWriter writes the results of the simulations of an ensemble to the
+//output files named in the parameters file. Finished simulations are handed to
+//it as they complete, in any order, and a dedicated thread writes each one, in
+//order of run number, while the remaining simulations are still being run.
+//Each simulation is freed as soon as it has been written. To bound the memory
+//used, a simulation which finishes too far ahead of the next one to be written
+//waits in submit() until the writer catches up.
+class ResultWriter {
+ private:
+  std::ofstream f_summary;
+  std::ofstream f_persist;
+  std::ofstream f_phylogeny;
+  std::ofstream f_species_stats;
+
+  //Parameter sets the simulations were run with
+  const Sweep &sweep;
+
+  //Finished simulations which have not yet been written, keyed by run number.
+  //This is the reorder buffer.
+  std::map<int, std::unique_ptr<Simulation> > pending;
+
+  //Run number of the next simulation to be written
+  int next_run = 0;
+
+  //How many run numbers ahead of next_run a simulation may be submitted
+  //without waiting
+  int capacity;
+
+  //Set once no more simulations will be submitted
+  bool finishing = false;
+
+  //Guards all of the above
+  std::mutex              mtx;
+  //Signalled when a simulation is submitted or finishing is set
+  std::condition_variable submitted;
+  //Signalled when a simulation has been written
+  std::condition_variable written;
+
+  //First exception thrown while writing; reported by finish()
+  std::exception_ptr error;
+
+  //Time spent writing
+  Timer timer_io;
+
+  std::thread thread;
+
+  //Body of the writing thread
+  void writeLoop();
+
+  //Writes one simulation's results to each of the output files
+  void write(const Simulation &sim);
+
+ public:
+  //Opens the output files and starts the writing thread. Up to capacity
+  //simulations may be waiting to be written at once. The simulations' parameter
+  //sets are drawn from sweep.
+  ResultWriter(int capacity, const Sweep &sweep);
+
+  //Stops the writing thread if finish() was not called
+  ~ResultWriter();
+
+  //Hands a finished simulation to the writer. Blocks while the simulation is
+  //too far ahead of those already written. Thread-safe.
+  void submit(std::unique_ptr<Simulation> sim);
+
+  //Waits until every submitted simulation has been written and stops the
+  //writing thread. Rethrows any exception raised while writing.
+  void finish();
+
+  //Time the writing thread has spent writing. Only valid after finish().
+  double ioTime();
+};
+
+//Header of the summary statistics file. The swept parameters are given their
+//own columns.
+std::string SimulationSummaryHeader(const Sweep &sweep);
+
+//Writes one line of the summary statistics file
+void printSimulationSummary(std::ostream &out, int r, const Simulation &sim, const Sweep &sweep);
+
+#endif